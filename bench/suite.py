@@ -0,0 +1,738 @@
+###################################################################
+#  Numexpr - Fast numerical array expression evaluator for NumPy.
+#
+#      License: MIT
+#      Author:  See AUTHORS.txt
+#
+#  See LICENSE.txt and LICENSES/*.txt for details about copyright and
+#  rights to use.
+####################################################################
+
+"""Benchmark suite of numexpr against NumPy.
+
+Runs a set of cases (elementwise, transcendental, boolean, string,
+reduction, strided and multidimensional expressions) with numexpr and
+with their NumPy equivalents, and writes the timings as JSON, so that
+the results of different versions or machines can be compared::
+
+  python bench/suite.py run -o new.json
+  python bench/suite.py compare old.json new.json
+
+`compare` flags the cases whose numexpr time grew beyond a noise
+threshold, and the cases of the old run missing from the new one, and
+exits with status 1 if there are any (missing cases can be allowed
+with `--allow-missing`, e.g. when comparing a filtered run).
+
+`scaling` sweeps thread counts, array sizes and expressions of
+increasing arithmetic intensity, and compares the bandwidth achieved
+with the one of STREAM-like kernels run by NumPy in as many threads::
+
+  python bench/suite.py scaling -T 1,2,4,8 -o scaling.json
+
+`latency` times single calls on small arrays with `evaluate()`, with
+precompiled `NumExpr` objects and with NumPy, and splits the time of
+`evaluate()` into its Python and C parts::
+
+  python bench/suite.py latency -n 100,1000,10000
+
+`train` is the training workload of the profile-guided builds (see
+the NUMEXPR_PGO variable of setup.py and CMakeLists.txt): it runs the
+cases above and a program for every opcode and function of the VM, on
+contiguous, strided and small operands, serially and in parallel, and
+with every ISA level of the engines.  `--check` only lists the opcodes
+and functions that the programs miss::
+
+  python bench/suite.py train --check
+"""
+
+from __future__ import print_function
+
+import argparse
+import gc
+import json
+import platform
+import sys
+import threading
+import time
+import timeit
+
+import numpy
+
+import numexpr
+
+# The default number of elements of the operands
+array_size = 1000 * 1000
+# The least time (in seconds) of every measurement
+min_time = 0.05
+
+
+def operands(size):
+    """The operands of the cases, by name."""
+    rng = numpy.random.RandomState(0)
+    a, b, c = (rng.uniform(0, 1, size) for i in range(3))
+    rows = max(size // 1000, 1)
+    m = rng.uniform(0, 1, (rows, size // rows))
+    words = numpy.array(['numexpr', 'numpy', 'python', 'expr', 'num'],
+                        dtype='S8')
+    strided = rng.uniform(0, 1, 2 * size)
+    return {
+        'a': a, 'b': b, 'c': c,
+        'fa': a.astype('f4'), 'fb': b.astype('f4'),
+        'ia': (a * 1000).astype('i4'), 'ib': (b * 1000).astype('i4'),
+        's1': words[(a * len(words)).astype('i4')],
+        's2': words[(b * len(words)).astype('i4')],
+        'sa': strided[::2], 'sb': strided[1::2],
+        'm': m, 'mf': numpy.asfortranarray(m), 'row': m[0].copy(),
+        'col': m[:, :1].copy(),
+        'mcol': rng.uniform(0, 1, (size, 4))[:, 1],
+        'np': numpy,
+    }
+
+
+# Every case is (group, numexpr expression, NumPy expression)
+cases = [
+    ('elementwise', 'a*b+c', 'a*b+c'),
+    ('elementwise', '2*a+3*b', '2*a+3*b'),
+    ('elementwise', 'a**2+b**2+2*a*b', 'a**2+b**2+2*a*b'),
+    ('elementwise', 'fa*fb+1', 'fa*fb+1'),
+    ('elementwise', 'ia*3+ib', 'ia*3+ib'),
+    ('transcendental', 'sin(a)**2+cos(a)**2',
+     'np.sin(a)**2+np.cos(a)**2'),
+    ('transcendental', 'exp(a)*log(b)', 'np.exp(a)*np.log(b)'),
+    ('transcendental', 'arctan2(a, b)', 'np.arctan2(a, b)'),
+    ('transcendental', 'sqrt(fa**2+fb**2)', 'np.sqrt(fa**2+fb**2)'),
+    ('boolean', '(a > 0.5) & (b < 0.5)', '(a > 0.5) & (b < 0.5)'),
+    ('boolean', 'where(a > b, a, b)', 'np.where(a > b, a, b)'),
+    ('boolean', '~(a > b) | (c > 0.5)', '~(a > b) | (c > 0.5)'),
+    ('string', 's1 == s2', 's1 == s2'),
+    ('string', 's1 < s2', 's1 < s2'),
+    ('reduction', 'sum(a*b)', '(a*b).sum()'),
+    ('reduction', 'sum(m, axis=1)', 'm.sum(axis=1)'),
+    ('reduction', 'prod(1+a*1e-6)', '(1+a*1e-6).prod()'),
+    ('strided', 'sa*sb+1', 'sa*sb+1'),
+    ('strided', 'mcol*2+1', 'mcol*2+1'),
+    ('multidim', 'm*m+1', 'm*m+1'),
+    ('multidim', 'm+mf', 'm+mf'),
+    ('multidim', 'm*row+col', 'm*row+col'),
+]
+
+
+def measure(func, repeats):
+    """Return the times per call (in seconds) of `repeats` measurements
+    of `func`, every one calling it enough times to take `min_time`."""
+    timer = timeit.default_timer
+    number = 1
+    while True:
+        t0 = timer()
+        for i in range(number):
+            func()
+        elapsed = timer() - t0
+        if elapsed >= min_time or number >= 1 << 20:
+            break
+        number *= 2
+    times = []
+    for r in range(repeats):
+        t0 = timer()
+        for i in range(number):
+            func()
+        times.append((timer() - t0) / number)
+    return times
+
+
+def summary(times):
+    times = sorted(times)
+    best, median = times[0], times[len(times) // 2]
+    # The relative spread of the measurements, as an estimate of noise
+    return {'best': best, 'median': median,
+            'spread': (median - best) / best if best > 0 else 0.0}
+
+
+def metadata(args):
+    return {
+        'numexpr': numexpr.__version__,
+        'numpy': numpy.__version__,
+        'python': platform.python_version(),
+        'platform': platform.platform(),
+        'machine': platform.machine(),
+        'processor': platform.processor(),
+        'ncores': numexpr.ncores,
+        'nthreads': args.threads,
+        'vml': numexpr.use_vml,
+        'size': args.size,
+        'repeats': args.repeats,
+        'date': time.strftime('%Y-%m-%dT%H:%M:%S'),
+    }
+
+
+def selected(args):
+    return [(group, ne_expr, np_expr) for group, ne_expr, np_expr in cases
+            if (not args.group or group in args.group) and
+            (not args.filter or args.filter in ne_expr)]
+
+
+def run(args):
+    numexpr.set_num_threads(args.threads)
+    namespace = operands(args.size)
+    results = []
+    print('%-15s %-25s %12s %12s %8s' %
+          ('group', 'expression', 'numexpr (s)', 'numpy (s)', 'speedup'))
+    for group, ne_expr, np_expr in selected(args):
+        code = compile(np_expr, '<suite>', 'eval')
+        ne_times = measure(
+            lambda: numexpr.evaluate(ne_expr, local_dict=namespace),
+            args.repeats)
+        np_times = measure(lambda: eval(code, namespace), args.repeats)
+        result = {
+            'name': '%s: %s' % (group, ne_expr),
+            'group': group,
+            'expression': ne_expr,
+            'numpy_expression': np_expr,
+            'numexpr': summary(ne_times),
+            'numpy': summary(np_times),
+        }
+        result['speedup'] = (result['numpy']['best'] /
+                             result['numexpr']['best'])
+        results.append(result)
+        print('%-15s %-25s %12.6f %12.6f %8.2f' %
+              (group, ne_expr, result['numexpr']['best'],
+               result['numpy']['best'], result['speedup']))
+        sys.stdout.flush()
+    report = {'metadata': metadata(args), 'results': results}
+    if args.output:
+        with open(args.output, 'w') as f:
+            json.dump(report, f, indent=2, sort_keys=True)
+    return 0
+
+
+def compare(args):
+    with open(args.old) as f:
+        old = json.load(f)
+    with open(args.new) as f:
+        new = json.load(f)
+    old_results = dict((r['name'], r) for r in old['results'])
+    new_names = set(r['name'] for r in new['results'])
+    # Cases renamed, filtered out or crashed in the new run
+    missing = [r['name'] for r in old['results']
+               if r['name'] not in new_names]
+    added = [r['name'] for r in new['results']
+             if r['name'] not in old_results]
+    regressions = 0
+    print('%-40s %12s %12s %8s' % ('case', 'old (s)', 'new (s)', 'ratio'))
+    for r in new['results']:
+        if r['name'] not in old_results:
+            continue
+        o = old_results[r['name']]['numexpr']
+        n = r['numexpr']
+        ratio = n['best'] / o['best']
+        # Noisy measurements need a larger change to count
+        threshold = max(args.threshold, o['spread'] + n['spread'])
+        if ratio > 1 + threshold:
+            flag = 'REGRESSION'
+            regressions += 1
+        elif ratio < 1 - threshold:
+            flag = 'improvement'
+        else:
+            flag = ''
+        print(('%-40s %12.6f %12.6f %8.2f %s' %
+               (r['name'], o['best'], n['best'], ratio, flag)).rstrip())
+    for name in added:
+        print('%-40s %12s %12s %8s %s' % (name, '-', '', '', 'new'))
+    for name in missing:
+        print('%-40s %12s %12s %8s %s' % (name, '', '-', '', 'MISSING'))
+    print('%d regression(s) beyond a %.0f%% threshold' %
+          (regressions, 100 * args.threshold))
+    if missing:
+        print('%d case(s) of the old run missing from the new one%s' %
+              (len(missing), ' (allowed)' if args.allow_missing else ''))
+    return 1 if regressions or (missing and not args.allow_missing) else 0
+
+
+# Expressions of increasing arithmetic intensity, for `scaling`
+scaling_cases = [
+    'a+b',
+    '2*a+3*b',
+    'a**2+b**2+2*a*b',
+    'sin(a)**2+cos(b)**2',
+    'arctan2(a, b)*exp(a)',
+]
+
+
+def parallel(func, size, nthreads):
+    """Call `func` on `nthreads` slices of range(size) at once."""
+    step = -(-size // nthreads)
+    threads = [threading.Thread(target=func, args=(slice(i, i + step),))
+               for i in range(0, size, step)]
+    for t in threads:
+        t.start()
+    for t in threads:
+        t.join()
+
+
+def stream(size, nthreads, repeats):
+    """The bandwidth (bytes/s) of the best of the copy, scale and add
+    kernels of STREAM, run by NumPy (which releases the GIL) on slices
+    of `size` doubles in `nthreads` threads."""
+    a = numpy.ones(size)
+    b = numpy.ones(size) * 2
+    c = numpy.zeros(size)
+    kernels = [
+        (lambda s: numpy.copyto(c[s], a[s]), 16),
+        (lambda s: numpy.multiply(c[s], 3.0, out=b[s]), 16),
+        (lambda s: numpy.add(a[s], b[s], out=c[s]), 24),
+    ]
+    best = 0
+    for kernel, nbytes in kernels:
+        times = measure(lambda: parallel(kernel, size, nthreads), repeats)
+        best = max(best, nbytes * size / min(times))
+    return best
+
+
+def scaling(args):
+    """Sweep thread counts and sizes.  Bandwidths above the STREAM-like
+    one (from large arrays) mean that the operands fit in the caches."""
+    if args.plot:
+        try:
+            import matplotlib
+        except ImportError:
+            print('--plot needs matplotlib', file=sys.stderr)
+            return 2
+    rng = numpy.random.RandomState(0)
+    # One thread is always run, as the reference of the speedups
+    threads = sorted(set([1] + args.thread_counts))
+    sizes = args.sizes
+    namespace = {'a': rng.uniform(0, 1, max(sizes)),
+                 'b': rng.uniform(0, 1, max(sizes))}
+    old_nthreads = numexpr.set_num_threads(1)
+
+    print('STREAM-like baseline (%d doubles):' % args.stream_size)
+    baseline = {}
+    for t in threads:
+        baseline[t] = stream(args.stream_size, t, args.repeats)
+        print('  %3d threads: %8.2f GB/s' % (t, baseline[t] * 1e-9))
+
+    results = []
+    print('%-22s %9s %7s %12s %8s %8s %8s' %
+          ('expression', 'size', 'threads', 'time (s)', 'speedup',
+           'GB/s', 'STREAM'))
+    for expr in scaling_cases:
+        for size in sizes:
+            local_dict = dict((k, v[:size]) for k, v in namespace.items())
+            cost = numexpr.analyze(expr, local_dict)
+            nbytes = (cost['memory_read'] + cost['memory_written']) * size
+            for t in threads:
+                numexpr.set_num_threads(t)
+                times = measure(
+                    lambda: numexpr.evaluate(expr, local_dict=local_dict),
+                    args.repeats)
+                best = min(times)
+                if t == 1:
+                    serial = best
+                bandwidth = nbytes / best
+                results.append({
+                    'expression': expr, 'size': size, 'threads': t,
+                    'intensity': cost['intensity'], 'time': best,
+                    'speedup': serial / best, 'bandwidth': bandwidth,
+                    'stream_fraction': bandwidth / baseline[t],
+                })
+                print('%-22s %9d %7d %12.6f %8.2f %8.2f %7.0f%%' %
+                      (expr, size, t, best, serial / best,
+                       bandwidth * 1e-9, 100 * bandwidth / baseline[t]))
+                sys.stdout.flush()
+    numexpr.set_num_threads(old_nthreads)
+
+    # The fastest thread count of every expression and size
+    print('fastest thread counts:')
+    for expr in scaling_cases:
+        counts = []
+        for size in sizes:
+            rows = [r for r in results
+                    if r['expression'] == expr and r['size'] == size]
+            counts.append('%d:%d' % (size, min(
+                rows, key=lambda r: r['time'])['threads']))
+        print('  %-22s %s' % (expr, ' '.join(counts)))
+
+    if args.output:
+        report = {'metadata': metadata(args),
+                  'stream': [{'threads': t, 'bandwidth': baseline[t]}
+                             for t in threads],
+                  'results': results}
+        with open(args.output, 'w') as f:
+            json.dump(report, f, indent=2, sort_keys=True)
+    if args.plot:
+        plot_scaling(results, args.plot)
+    return 0
+
+
+def plot_scaling(results, filename):
+    """Plot the speedup curves of every expression (needs matplotlib)."""
+    import matplotlib
+    matplotlib.use('Agg')
+    import matplotlib.pyplot as plt
+
+    fig, axes = plt.subplots(1, len(scaling_cases), sharey=True,
+                             figsize=(4 * len(scaling_cases), 4))
+    for ax, expr in zip(axes, scaling_cases):
+        sizes = sorted(set(r['size'] for r in results))
+        for size in sizes:
+            rows = [r for r in results
+                    if r['expression'] == expr and r['size'] == size]
+            ax.plot([r['threads'] for r in rows],
+                    [r['speedup'] for r in rows], marker='o',
+                    label=str(size))
+        ax.set_title(expr)
+        ax.set_xlabel('threads')
+    axes[0].set_ylabel('speedup')
+    axes[0].legend(title='size')
+    fig.tight_layout()
+    fig.savefig(filename)
+
+
+# Expressions for `latency`, with their NumPy equivalents
+latency_cases = [
+    ('a+b', 'a+b'),
+    ('2*a+3*b', '2*a+3*b'),
+    ('sin(a)+b', 'np.sin(a)+b'),
+    ('sum(a*b)', '(a*b).sum()'),
+]
+
+# The phases of evaluate() run by the Python layer and by the VM (see
+# numexpr.get_timings())
+python_phases = ('parse',)
+c_phases = ('setup', 'copies', 'compute', 'finalize')
+
+
+def call_times(func, calls):
+    """Return the time (in seconds) of every one of `calls` calls."""
+    timer = timeit.default_timer
+    for i in range(min(calls, 100)):
+        func()
+    times = []
+    gc_enabled = gc.isenabled()
+    gc.disable()
+    try:
+        for i in range(calls):
+            t0 = timer()
+            func()
+            times.append(timer() - t0)
+    finally:
+        if gc_enabled:
+            gc.enable()
+    return times
+
+
+def percentiles(times):
+    return {'p50': float(numpy.percentile(times, 50)),
+            'p99': float(numpy.percentile(times, 99))}
+
+
+def breakdown(expr, local_dict, calls):
+    """The median time of the phases of evaluate() calls, split into
+    the Python layer (parsing and cache lookups, and the rest of the
+    call outside of the VM) and the VM."""
+    old_timing = numexpr.set_timing(True)
+    numexpr.get_timings(reset=True)
+    try:
+        for i in range(calls):
+            numexpr.evaluate(expr, local_dict=local_dict)
+        records = numexpr.get_timings(reset=True)['calls']
+    finally:
+        numexpr.set_timing(old_timing)
+    phases = {}
+    for phase in python_phases + c_phases + ('total',):
+        phases[phase] = float(numpy.median([r[phase] for r in records]))
+    c_time = sum(phases[phase] for phase in c_phases)
+    phases['python'] = phases['total'] - c_time
+    phases['c'] = c_time
+    return phases
+
+
+def latency(args):
+    rng = numpy.random.RandomState(0)
+    numexpr.set_num_threads(args.threads)
+    results = []
+    print('%-10s %6s  %-18s %-18s %-18s  %s' %
+          ('expression', 'size', 'numpy p50/p99', 'evaluate p50/p99',
+           'NumExpr p50/p99', 'evaluate: python + C (us)'))
+    for expr, np_expr in latency_cases:
+        for size in args.sizes:
+            namespace = {'a': rng.uniform(0, 1, size),
+                         'b': rng.uniform(0, 1, size), 'np': numpy}
+            local_dict = {'a': namespace['a'], 'b': namespace['b']}
+            a, b = local_dict['a'], local_dict['b']
+            code = compile(np_expr, '<suite>', 'eval')
+            compiled = numexpr.NumExpr(expr, [('a', numpy.double),
+                                              ('b', numpy.double)])
+            result = {
+                'expression': expr, 'size': size,
+                'numpy': percentiles(call_times(
+                    lambda: eval(code, namespace), args.calls)),
+                'evaluate': percentiles(call_times(
+                    lambda: numexpr.evaluate(expr, local_dict=local_dict),
+                    args.calls)),
+                'numexpr_object': percentiles(call_times(
+                    lambda: compiled(a, b), args.calls)),
+                'phases': breakdown(expr, local_dict, args.calls),
+            }
+            results.append(result)
+            us = lambda t: 1e6 * t
+            print('%-10s %6d  %7.2f / %-8.2f %7.2f / %-8.2f '
+                  '%7.2f / %-8.2f %6.2f + %.2f' %
+                  (expr, size,
+                   us(result['numpy']['p50']), us(result['numpy']['p99']),
+                   us(result['evaluate']['p50']),
+                   us(result['evaluate']['p99']),
+                   us(result['numexpr_object']['p50']),
+                   us(result['numexpr_object']['p99']),
+                   us(result['phases']['python']),
+                   us(result['phases']['c'])))
+            sys.stdout.flush()
+
+    if args.output:
+        report = {'metadata': metadata(args), 'results': results}
+        with open(args.output, 'w') as f:
+            json.dump(report, f, indent=2, sort_keys=True)
+    return 0
+
+
+# The operands of the programs of `train`, by signature character
+train_names = {'b': ('ba', 'bb'), 'i': ('ia', 'ib'), 'l': ('la', 'lb'),
+               'f': ('fa', 'fb'), 'd': ('a', 'b'), 'c': ('ca', 'cb'),
+               's': ('s1', 's2'), 'v': ('v', 'w')}
+
+# How the opcodes are written (by the name before their signature)
+train_templates = {
+    'add': '{0} + {1}', 'sub': '{0} - {1}', 'mul': '{0} * {1}',
+    'div': '{0} / {1}', 'mod': '{0} % {1}', 'pow': '{0} ** {1}',
+    'neg': '-{0}', 'invert': '~{0}', 'and': '{0} & {1}', 'or': '{0} | {1}',
+    'lshift': '{0} << {1}', 'rshift': '{0} >> {1}', 'eq': '{0} == {1}',
+    'ne': '{0} != {1}', 'gt': '{0} > {1}', 'ge': '{0} >= {1}',
+    'where': 'where({0}, {1}, {2})', 'ones_like': '{0} ** 0',
+    'copy': '{0}', 'sqrt': 'sqrt({0})', 'sum': 'sum({0})',
+    'prod': 'prod({0})', 'real': 'real({0})', 'imag': 'imag({0})',
+    'complex': 'complex({0}, {1})', 'contains': 'contains({0}, {1})',
+    'dot': 'dot({0}, {1})', 'cross': 'cross({0}, {1})', 'norm': 'norm({0})',
+    # The operand is cast to the kind of the other one
+    'cast': '{0} + {1}',
+}
+
+# The names of the functions in expressions, when they differ
+train_functions = {'absolute': 'abs', 'conjugate': 'conj', 'pow': None}
+
+# The opcodes and functions that no expression compiles to
+train_unreachable = set(['noop', 'copy_vv', 'conjugate_dd', 'conjugate_ff'])
+if sys.version_info[0] > 2:
+    # Integers are always divided into doubles
+    train_unreachable.update(['div_iii', 'div_lll'])
+
+# Reductions over an axis and along the outer dimension
+train_extra = ['sum(m, axis=0)', 'prod(m*1e-3 + 1, axis=1)',
+               'sum(mf*2, axis=1)', 'where(m > 0.5, m, -m)']
+
+
+def train_operands(size):
+    """The operands of the programs of `train` (the ones of the cases
+    and more), by name."""
+    namespace = operands(size)
+    del namespace['np']
+    rng = numpy.random.RandomState(1)
+    a, b = namespace['a'], namespace['b']
+    # No zeros in the right operands of integer divisions
+    ia, ib = namespace['ia'], (b * 30).astype('i4') + 1
+    namespace.update({
+        'ib': ib, 'la': ia.astype('i8'), 'lb': ib.astype('i8'),
+        'ba': a > 0.5, 'bb': b > 0.5, 'ca': a + 1j * b, 'cb': b - 1j * a,
+        'v': rng.uniform(0, 1, (size, 3)), 'w': rng.uniform(0, 1, (size, 3)),
+    })
+    return namespace
+
+
+def train_expression(name):
+    """The expression of an opcode or function (as in `opcodes` and
+    `funccodes` of numexpr.interpreter) or None."""
+    name = name.decode('ascii') if isinstance(name, bytes) else name
+    if '_' not in name:
+        return None
+    op, sig = name.rsplit('_', 1)
+    args = []
+    for kind in sig[1:]:
+        if kind != 'n':
+            args.append(train_names[kind][sum(k == kind for k in args)])
+    if op == 'cast':
+        args.append(train_names[sig[0]][1])
+    if op in train_templates:
+        return train_templates[op].format(*args)
+    if op == 'func' or (op not in numexpr.expressions.functions and
+                        op not in train_functions):
+        return None
+    func = train_functions.get(op, op)
+    if func is None:
+        return '%s ** %s' % tuple(args)
+    return '%s(%s)' % (func, ', '.join(args))
+
+
+def train_programs():
+    """The expressions of `train`."""
+    names = sorted(numexpr.interpreter.opcodes) + \
+        sorted(numexpr.interpreter.funccodes)
+    exprs = [train_expression(name) for name in names]
+    return [ex for ex in exprs if ex is not None] + train_extra + \
+        [ex for group, ex, np_expr in cases]
+
+
+def train_coverage(exprs, namespace):
+    """The opcodes and functions that the expressions do not use."""
+    from numexpr.necompiler import _getCompiled
+    opcodes = dict((v, k) for k, v in numexpr.interpreter.opcodes.items())
+    funccodes = dict((v, k) for k, v in
+                     numexpr.interpreter.funccodes.items())
+    missing = set(opcodes.values()) | set(funccodes.values())
+    for ex in exprs:
+        program = _getCompiled(ex, namespace, {}, {}, 0).program
+        for pc in range(0, len(program), 4):
+            op = opcodes[bytearray(program[pc:pc + 1])[0]]
+            missing.discard(op)
+            if op.startswith(b'func_'):
+                # The function code is the last argument, and the ones
+                # after the third go in the next (noop) instruction
+                k = len(op) - len(b'func_')
+                k = pc + k if k <= 3 else pc + k + 1
+                missing.discard(funccodes.get(bytearray(program[k:k + 1])[0]))
+    return sorted(name.decode('ascii') for name in missing
+                  if name.decode('ascii') not in train_unreachable)
+
+
+def train(args):
+    exprs = train_programs()
+    missing = train_coverage(exprs, train_operands(30))
+    if missing:
+        print('not covered: %s' % ', '.join(missing))
+    if args.check:
+        return 1 if missing else 0
+
+    contiguous = train_operands(args.size)
+    # Every other element of the vectors and of the rows of the matrices
+    strided = {}
+    for name, x in train_operands(2 * args.size).items():
+        vector = x.ndim == 1 or name in ('v', 'w')
+        strided[name] = x[::2] if vector else x[:, ::2]
+    layouts = [('contiguous', contiguous, args.repeats),
+               ('strided', strided, args.repeats),
+               ('small', train_operands(37), 20 * args.repeats),
+               ('block', train_operands(3000), 5 * args.repeats)]
+    thread_counts = sorted(set([1, max(2, numexpr.ncores)]))
+    level = numexpr.get_isa_level()
+    nthreads = numexpr.set_num_threads(1)
+    try:
+        for isa in numexpr.isa_levels:
+            numexpr.set_isa_level(isa)
+            t0 = time.time()
+            for n in thread_counts:
+                numexpr.set_num_threads(n)
+                for layout, namespace, repeats in layouts:
+                    for ex in exprs:
+                        for r in range(repeats):
+                            numexpr.evaluate(ex, local_dict=namespace)
+            # The pipelined buffering of serial calls
+            numexpr.set_num_threads(1)
+            numexpr.set_pipelined_buffering(True)
+            for ex in exprs:
+                numexpr.evaluate(ex, local_dict=strided)
+            numexpr.set_pipelined_buffering(False)
+            print('%-12s %d programs in %.1f s' %
+                  (isa, len(exprs), time.time() - t0))
+            sys.stdout.flush()
+    finally:
+        numexpr.set_isa_level(level)
+        numexpr.set_num_threads(nthreads)
+    return 0
+
+
+def int_list(text):
+    return [int(x) for x in text.split(',')]
+
+
+def main(argv=None):
+    parser = argparse.ArgumentParser(
+        description='Benchmark suite of numexpr against NumPy.')
+    commands = parser.add_subparsers(dest='command')
+
+    p = commands.add_parser('run', help='run the cases')
+    p.add_argument('-o', '--output', help='write the results as JSON')
+    p.add_argument('-n', '--size', type=int, default=array_size,
+                   help='elements of the operands (default %(default)s)')
+    p.add_argument('-r', '--repeats', type=int, default=5,
+                   help='measurements of every case (default %(default)s)')
+    p.add_argument('-t', '--threads', type=int, default=numexpr.ncores,
+                   help='numexpr threads (default %(default)s)')
+    p.add_argument('-g', '--group', action='append',
+                   help='only run the cases of a group (can be repeated)')
+    p.add_argument('-k', '--filter',
+                   help='only run the expressions containing this')
+    p.set_defaults(func=run)
+
+    p = commands.add_parser('compare',
+                            help='compare the numexpr times of two runs')
+    p.add_argument('old')
+    p.add_argument('new')
+    p.add_argument('--threshold', type=float, default=0.1,
+                   help='relative slowdown flagged as a regression '
+                   '(default %(default)s)')
+    p.add_argument('--allow-missing', action='store_true',
+                   help='do not fail on cases of the old run missing '
+                   'from the new one')
+    p.set_defaults(func=compare)
+
+    block_size = numexpr.interpreter.block_size
+    p = commands.add_parser('scaling',
+                            help='sweep thread counts and array sizes')
+    p.add_argument('-o', '--output', help='write the results as JSON')
+    p.add_argument('-T', '--thread-counts', type=int_list,
+                   default=sorted(set([1, 2, 4, 8, 16, 32, 64][
+                       :numexpr.ncores.bit_length()] + [numexpr.ncores])),
+                   help='comma separated thread counts, 1 is always '
+                   'added as the reference (default %(default)s)')
+    # Sizes around the threshold of the parallel code (2 blocks) and up
+    # to larger than the caches
+    p.add_argument('-n', '--sizes', type=int_list,
+                   default=[block_size, 2 * block_size, 16 * block_size,
+                            1 << 17, 1 << 20, 1 << 23],
+                   help='comma separated array sizes (default %(default)s)')
+    p.add_argument('-s', '--stream-size', type=int, default=1 << 23,
+                   help='doubles of the STREAM-like kernels '
+                   '(default %(default)s)')
+    p.add_argument('-r', '--repeats', type=int, default=5,
+                   help='measurements of every case (default %(default)s)')
+    p.add_argument('--plot', help='plot the speedups to this image file')
+    p.set_defaults(func=scaling, threads=None, size=None)
+
+    p = commands.add_parser('latency',
+                            help='time single calls on small arrays')
+    p.add_argument('-o', '--output', help='write the results as JSON')
+    p.add_argument('-n', '--sizes', type=int_list,
+                   default=[100, 1000, 10000],
+                   help='comma separated array sizes (default %(default)s)')
+    p.add_argument('-c', '--calls', type=int, default=2000,
+                   help='calls timed per case (default %(default)s)')
+    p.add_argument('-t', '--threads', type=int, default=numexpr.ncores,
+                   help='numexpr threads (default %(default)s)')
+    p.set_defaults(func=latency, size=None, repeats=None)
+
+    p = commands.add_parser('train',
+                            help='run the training workload of PGO builds')
+    p.add_argument('-n', '--size', type=int, default=100000,
+                   help='elements of the operands (default %(default)s)')
+    p.add_argument('-r', '--repeats', type=int, default=2,
+                   help='calls of every program (default %(default)s)')
+    p.add_argument('--check', action='store_true',
+                   help='only list the opcodes and functions not covered')
+    p.set_defaults(func=train)
+
+    args = parser.parse_args(argv)
+    if getattr(args, 'func', None) is None:
+        parser.print_help()
+        return 2
+    return args.func(args)
+
+
+if __name__ == '__main__':
+    sys.exit(main())
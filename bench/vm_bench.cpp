@@ -0,0 +1,650 @@
+// Numexpr - Fast numerical array expression evaluator for NumPy.
+//
+//      License: MIT
+//      Author:  See AUTHORS.txt
+//
+//  See LICENSE.txt for details about copyright and rights to use.
+//
+// vm_bench.cpp runs every opcode (and every function of the func_*
+// opcodes) and a few reference programs straight through the VM
+// (vm_engine_iter_task), on synthetic operands and without the Python
+// layer of numexpr, for several block sizes and input strides.  For
+// every case it reports the best time per element and the throughput
+// of the operands and the outcome.
+//
+// It is built by CMake when NUMEXPR_BUILD_BENCH is on.  Python is only
+// embedded to build the NumPy iterators, so it must be able to import
+// NumPy (set PYTHONPATH if it lives in a virtualenv).  Usage:
+//
+//   vm_bench [-n elements] [-r repeats] [-b blocks] [-s strides] [filter]
+//
+// where `blocks` and `strides` are comma separated lists, and only the
+// cases whose name contains `filter` (e.g. "op:add_", "prog:") are run.
+
+#include "module.hpp"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include "interpreter.hpp"
+
+using namespace std;
+
+#if PY_MAJOR_VERSION >= 3
+extern "C" PyObject *PyInit_interpreter(void);
+#else
+extern "C" void initinterpreter(void);
+#endif
+
+// Item size of string operands
+#define STRING_SIZE 16
+
+#define Tb 'b'
+#define Ti 'i'
+#define Tl 'l'
+#define Tf 'f'
+#define Td 'd'
+#define Tc 'c'
+#define Ts 's'
+#define Tv 'v'
+#define Tn 'n'
+#define T0 0
+
+struct opcode_info {
+    int code;
+    const char *name;
+    char sig[4];        // return type and arguments (0 if none)
+};
+
+static const opcode_info opcode_table[] = {
+#define OPCODE(n, e, ex, rt, a1, a2, a3) {n, ex, {rt, a1, a2, a3}},
+#include "opcodes.hpp"
+#undef OPCODE
+};
+
+struct function_info {
+    int code;
+    const char *name;
+};
+
+static const function_info function_table[] = {
+#define FUNC_FF(fop, s, ...) {fop, s},
+#define FUNC_FFF(fop, s, ...) {fop, s},
+#define FUNC_DD(fop, s, ...) {fop, s},
+#define FUNC_DDD(fop, s, ...) {fop, s},
+#define FUNC_CC(fop, s, ...) {fop, s},
+#define FUNC_CCC(fop, s, ...) {fop, s},
+#include "functions.hpp"
+#undef FUNC_CCC
+#undef FUNC_CC
+#undef FUNC_DDD
+#undef FUNC_DD
+#undef FUNC_FFF
+#undef FUNC_FF
+};
+
+#undef Tb
+#undef Ti
+#undef Tl
+#undef Tf
+#undef Td
+#undef Tc
+#undef Ts
+#undef Tv
+#undef Tn
+#undef T0
+
+/* A program to benchmark.  Its registers are laid out like in NumExpr
+   objects: the output, the inputs, the constants and the temporaries. */
+struct bench_case {
+    string name;
+    string sig;                 // the output and the inputs
+    string constsig;
+    vector<double> constants;
+    string tempsig;
+    vector<unsigned char> program;
+    bool reduction;
+};
+
+static void
+emit(bench_case *c, int op, int store_in, int arg1 = 0, int arg2 = 0)
+{
+    c->program.push_back((unsigned char)op);
+    c->program.push_back((unsigned char)store_in);
+    c->program.push_back((unsigned char)arg1);
+    c->program.push_back((unsigned char)arg2);
+}
+
+/* A case running the opcode `op` alone.  `function` is the code passed
+   to func_* opcodes (or the axis of reductions). */
+static bench_case
+opcode_case(const opcode_info &op, const char *name, int function)
+{
+    bench_case c;
+    int args[3] = {0, 0, 0};
+
+    c.name = string("op:") + name;
+    c.sig = op.sig[0];
+    c.reduction = (strncmp(op.name, "sum_", 4) == 0 ||
+                   strncmp(op.name, "prod_", 5) == 0);
+    for (int k = 1; k < 4 && op.sig[k] != 0; k++) {
+        if (op.sig[k] == 'n') {
+            args[k-1] = function;
+        }
+        else {
+            c.sig += op.sig[k];
+            args[k-1] = (int)c.sig.size() - 1;
+        }
+    }
+    emit(&c, op.code, 0, args[0], args[1]);
+    if (op.sig[3] != 0) {
+        // The third argument is carried by a noop
+        emit(&c, OP_NOOP, args[2]);
+    }
+    return c;
+}
+
+/* All the opcodes, with the func_* ones once per function */
+static void
+add_opcode_cases(vector<bench_case> *cases)
+{
+    int n_opcodes = sizeof(opcode_table) / sizeof(opcode_table[0]);
+    int n_functions = sizeof(function_table) / sizeof(function_table[0]);
+
+    for (int i = 0; i < n_opcodes; i++) {
+        const opcode_info &op = opcode_table[i];
+        if (op.name == NULL || op.code == OP_NOOP) {
+            continue;
+        }
+        if (strncmp(op.name, "func_", 5) != 0) {
+            cases->push_back(opcode_case(op, op.name, 0));
+            continue;
+        }
+        // The functions of "func_ddn" are those named "*_dd"
+        string fsig = string(op.name + 5);
+        fsig.erase(fsig.size() - 1);
+        for (int f = 0; f < n_functions; f++) {
+            const char *fname = function_table[f].name;
+            if (fname == NULL) {
+                continue;
+            }
+            const char *suffix = strrchr(fname, '_');
+            if (suffix != NULL && fsig == suffix + 1) {
+                cases->push_back(opcode_case(op, fname,
+                                             function_table[f].code));
+            }
+        }
+    }
+}
+
+/* Programs like the ones compiled for some typical expressions */
+static void
+add_program_cases(vector<bench_case> *cases)
+{
+    bench_case c;
+
+    c = bench_case();
+    c.name = "prog:a*b+c";
+    c.sig = "dddd";
+    emit(&c, OP_MUL_DDD, 0, 1, 2);
+    emit(&c, OP_ADD_DDD, 0, 0, 3);
+    cases->push_back(c);
+
+    c = bench_case();
+    c.name = "prog:2*a+3*b";
+    c.sig = "ddd";
+    c.constsig = "dd";
+    c.constants.push_back(2);
+    c.constants.push_back(3);
+    c.tempsig = "d";
+    emit(&c, OP_MUL_DDD, 5, 3, 1);
+    emit(&c, OP_MUL_DDD, 0, 4, 2);
+    emit(&c, OP_ADD_DDD, 0, 5, 0);
+    cases->push_back(c);
+
+    c = bench_case();
+    c.name = "prog:((.25*x+.75)*x-1.5)*x-2";
+    c.sig = "dd";
+    c.constsig = "dddd";
+    c.constants.push_back(.25);
+    c.constants.push_back(.75);
+    c.constants.push_back(1.5);
+    c.constants.push_back(2);
+    emit(&c, OP_MUL_DDD, 0, 2, 1);
+    emit(&c, OP_ADD_DDD, 0, 0, 3);
+    emit(&c, OP_MUL_DDD, 0, 0, 1);
+    emit(&c, OP_SUB_DDD, 0, 0, 4);
+    emit(&c, OP_MUL_DDD, 0, 0, 1);
+    emit(&c, OP_SUB_DDD, 0, 0, 5);
+    cases->push_back(c);
+
+    c = bench_case();
+    c.name = "prog:sin(a)**2+cos(a)**2";
+    c.sig = "dd";
+    c.tempsig = "d";
+    emit(&c, OP_FUNC_DDN, 2, 1, FUNC_SIN_DD);
+    emit(&c, OP_MUL_DDD, 2, 2, 2);
+    emit(&c, OP_FUNC_DDN, 0, 1, FUNC_COS_DD);
+    emit(&c, OP_MUL_DDD, 0, 0, 0);
+    emit(&c, OP_ADD_DDD, 0, 2, 0);
+    cases->push_back(c);
+
+    c = bench_case();
+    c.name = "prog:where(a>b,a,b)";
+    c.sig = "ddd";
+    c.tempsig = "b";
+    emit(&c, OP_GT_BDD, 3, 1, 2);
+    emit(&c, OP_WHERE_DBDD, 0, 3, 1);
+    emit(&c, OP_NOOP, 2);
+    cases->push_back(c);
+
+    c = bench_case();
+    c.name = "prog:(a>1)&(1>b)";
+    c.sig = "bdd";
+    c.constsig = "d";
+    c.constants.push_back(1);
+    c.tempsig = "b";
+    emit(&c, OP_GT_BDD, 4, 1, 3);
+    emit(&c, OP_GT_BDD, 0, 3, 2);
+    emit(&c, OP_AND_BBB, 0, 4, 0);
+    cases->push_back(c);
+
+    c = bench_case();
+    c.name = "prog:sqrt(a*a+b*b)[f4]";
+    c.sig = "fff";
+    c.tempsig = "f";
+    emit(&c, OP_MUL_FFF, 3, 1, 1);
+    emit(&c, OP_MUL_FFF, 0, 2, 2);
+    emit(&c, OP_ADD_FFF, 0, 3, 0);
+    emit(&c, OP_FUNC_FFN, 0, 0, FUNC_SQRT_FF);
+    cases->push_back(c);
+
+    c = bench_case();
+    c.name = "prog:sum(a*b)";
+    c.sig = "ddd";
+    c.tempsig = "d";
+    c.reduction = true;
+    emit(&c, OP_MUL_DDD, 3, 1, 2);
+    emit(&c, OP_SUM_DDN, 0, 3, 0);
+    cases->push_back(c);
+}
+
+static PyArray_Descr *
+bench_dtype(char c)
+{
+    PyArray_Descr *dtype;
+
+    switch (c) {
+        case 'b': return PyArray_DescrFromType(NPY_BOOL);
+        case 'i': return PyArray_DescrFromType(NPY_INT);
+        case 'l': return PyArray_DescrFromType(NPY_LONGLONG);
+        case 'f': return PyArray_DescrFromType(NPY_FLOAT);
+        case 'd': return PyArray_DescrFromType(NPY_DOUBLE);
+        case 'c': return PyArray_DescrFromType(NPY_CDOUBLE);
+        case 's':
+            dtype = PyArray_DescrNewFromType(NPY_STRING);
+            dtype->elsize = STRING_SIZE;
+            return dtype;
+        case 'v':
+            dtype = PyArray_DescrNewFromType(NPY_VOID);
+            dtype->elsize = 3*sizeof(double);
+            return dtype;
+    }
+    return NULL;
+}
+
+/* Store in `p` the i-th value of a synthetic operand of type `c`.
+   Floating point values are in [0.5, 1.5), in the domain of most
+   functions and away from overflows and denormals, and integers are
+   small enough for pow(). */
+static void
+fill_value(char c, char *p, npy_intp i, int k)
+{
+    double x = 0.5 + (double)((i * 7919 + k * 104729) % 1000) / 1000;
+
+    switch (c) {
+        case 'b': *(npy_bool *)p = (i + k) % 3 != 0; break;
+        case 'i': *(int *)p = (int)(i % 16) + 1 + k; break;
+        case 'l': *(long long *)p = (long long)(i % 16) + 1 + k; break;
+        case 'f': *(float *)p = (float)x; break;
+        case 'd': *(double *)p = x; break;
+        case 'c': ((double *)p)[0] = x; ((double *)p)[1] = 1.5 - x; break;
+        case 's':
+            // NUL padded, like most NumPy strings
+            memset(p, 0, STRING_SIZE);
+            for (int j = 0; j < STRING_SIZE / 2 + (i + k) % 8; j++) {
+                p[j] = 'a' + (char)((i + j + k) % 26);
+            }
+            break;
+        case 'v':
+            ((double *)p)[0] = x;
+            ((double *)p)[1] = 1.5 - x;
+            ((double *)p)[2] = x * x;
+            break;
+    }
+}
+
+/* An operand of `n` elements, `stride` elements apart */
+static PyArrayObject *
+make_operand(char c, npy_intp n, int stride, int k)
+{
+    npy_intp total = n * stride;
+    PyArray_Descr *dtype = bench_dtype(c);
+
+    Py_INCREF(dtype);
+    PyArrayObject *base = (PyArrayObject *)PyArray_NewFromDescr(
+            &PyArray_Type, dtype, 1, &total, NULL, NULL, 0, NULL);
+    if (base == NULL) {
+        Py_DECREF(dtype);
+        return NULL;
+    }
+    char *data = (char *)PyArray_DATA(base);
+    for (npy_intp i = 0; i < total; i++) {
+        fill_value(c, data + i * dtype->elsize, i, k);
+    }
+    if (stride == 1) {
+        Py_DECREF(dtype);
+        return base;
+    }
+    npy_intp strides = stride * dtype->elsize;
+    PyArrayObject *view = (PyArrayObject *)PyArray_NewFromDescr(
+            &PyArray_Type, dtype, 1, &n, &strides, data, 0, NULL);
+    if (view == NULL || PyArray_SetBaseObject(view, (PyObject *)base) < 0) {
+        Py_XDECREF(view);
+        Py_DECREF(base);
+        return NULL;
+    }
+    return view;
+}
+
+/* Reset the outcome of a reduction to the identity of the opcode */
+static void
+reset_reduction(const bench_case &c, PyArrayObject *output)
+{
+    char *p = (char *)PyArray_DATA(output);
+
+    memset(p, 0, PyArray_ITEMSIZE(output));
+    if (c.program[c.program.size() - 4] >= OP_PROD) {
+        switch (c.sig[0]) {
+            case 'i': *(int *)p = 1; break;
+            case 'l': *(long long *)p = 1; break;
+            case 'f': *(float *)p = 1; break;
+            case 'd': *(double *)p = 1; break;
+            case 'c': ((double *)p)[0] = 1; ((double *)p)[1] = 0; break;
+        }
+    }
+}
+
+/* Run `c` over `n` elements `repeats` times, and store its best time
+   in `best`.  Returns -1 (with a Python exception) on errors. */
+static int
+run_case(const bench_case &c, npy_intp n, npy_intp block_size, int stride,
+         int repeats, double *best)
+{
+    int n_inputs = (int)c.sig.size() - 1;
+    int n_constants = (int)c.constsig.size();
+    int n_temps = (int)c.tempsig.size();
+    int n_regs = 1 + n_inputs + n_constants + n_temps;
+    PyArrayObject *operands[NPY_MAXARGS];
+    npy_uint32 op_flags[NPY_MAXARGS];
+    vector<char *> mem(n_regs);
+    vector<npy_intp> memsteps(n_regs), memsizes(n_regs);
+    vector<char> constants;
+    vm_params params;
+    NpyIter *iter = NULL;
+    char *errmsg = NULL;
+    int pc_error = -1, r, ret = -1;
+
+    memset(operands, 0, sizeof(operands));
+    for (r = 0; r <= n_inputs; r++) {
+        if (r == 0) {
+            // The outcome is contiguous, like in NumExpr_run
+            npy_intp nd = c.reduction ? 0 : 1;
+            operands[0] = (PyArrayObject *)PyArray_NewFromDescr(
+                    &PyArray_Type, bench_dtype(c.sig[0]), (int)nd, &n,
+                    NULL, NULL, 0, NULL);
+        }
+        else {
+            operands[r] = make_operand(c.sig[r], n, stride, r);
+        }
+        if (operands[r] == NULL) {
+            goto cleanup;
+        }
+        mem[r] = NULL;
+        memsteps[r] = memsizes[r] = PyArray_ITEMSIZE(operands[r]);
+        op_flags[r] = NPY_ITER_NBO | NPY_ITER_ALIGNED |
+            (r > 0 ? NPY_ITER_READONLY :
+             c.reduction ? NPY_ITER_READWRITE : NPY_ITER_WRITEONLY);
+    }
+
+    // Every constant takes a block of BLOCK_SIZE1 copies
+    constants.resize(n_constants * BLOCK_SIZE1 * sizeof(double));
+    for (int i = 0; i < n_constants; i++) {
+        r = 1 + n_inputs + i;
+        char t = c.constsig[i];
+        npy_intp size = t == 'f' ? sizeof(float) : sizeof(double);
+        mem[r] = &constants[i * BLOCK_SIZE1 * sizeof(double)];
+        memsteps[r] = memsizes[r] = size;
+        for (int j = 0; j < BLOCK_SIZE1; j++) {
+            if (t == 'f') {
+                ((float *)mem[r])[j] = (float)c.constants[i];
+            }
+            else {
+                ((double *)mem[r])[j] = c.constants[i];
+            }
+        }
+    }
+    for (int i = 0; i < n_temps; i++) {
+        r = 1 + n_inputs + n_constants + i;
+        PyArray_Descr *dtype = bench_dtype(c.tempsig[i]);
+        memsteps[r] = memsizes[r] = dtype->elsize;
+        Py_DECREF(dtype);
+    }
+
+    params.prog_len = (int)c.program.size();
+    params.program = (unsigned char *)&c.program[0];
+    params.n_inputs = n_inputs;
+    params.n_constants = n_constants;
+    params.n_temps = n_temps;
+    params.r_end = n_regs;
+    params.output = NULL;
+    params.inputs = NULL;
+    params.mem = &mem[0];
+    params.memsteps = &memsteps[0];
+    params.memsizes = &memsizes[0];
+    params.index_data = NULL;
+    params.out_buffer = NULL;
+    params.counters = NULL;
+
+    iter = NpyIter_AdvancedNew(n_inputs + 1, operands,
+                               NPY_ITER_BUFFERED |
+                               NPY_ITER_REDUCE_OK |
+                               (c.reduction ? 0 : NPY_ITER_RANGED) |
+                               NPY_ITER_DELAY_BUFALLOC |
+                               NPY_ITER_EXTERNAL_LOOP,
+                               NPY_KEEPORDER, NPY_SAFE_CASTING,
+                               op_flags, NULL, -1, NULL, NULL, block_size);
+    if (iter == NULL) {
+        goto cleanup;
+    }
+    if (get_temps_space(params, params.mem, block_size) < 0) {
+        free_temps_space(params, params.mem);
+        PyErr_NoMemory();
+        goto cleanup;
+    }
+
+    // The first run just warms up the caches and the buffers
+    *best = -1;
+    for (int i = 0; i <= repeats; i++) {
+        if (c.reduction) {
+            reset_reduction(c, operands[0]);
+        }
+        if (NpyIter_Reset(iter, NULL) != NPY_SUCCEED) {
+            break;
+        }
+        double t0 = nx_seconds();
+        r = vm_engine_iter_task(iter, params.memsteps, params,
+                                &pc_error, &errmsg);
+        double t = nx_seconds() - t0;
+        if (r < 0) {
+            PyErr_SetString(PyExc_RuntimeError,
+                            errmsg != NULL ? errmsg : "VM error");
+            break;
+        }
+        if (i > 0 && (*best < 0 || t < *best)) {
+            *best = t;
+        }
+        if (i == repeats) {
+            ret = 0;
+        }
+    }
+    free_temps_space(params, params.mem);
+
+cleanup:
+    if (iter != NULL) {
+        NpyIter_Deallocate(iter);
+    }
+    for (r = 0; r <= n_inputs; r++) {
+        Py_XDECREF(operands[r]);
+    }
+    return ret;
+}
+
+/* Parse a comma separated list of positive integers */
+static vector<npy_intp>
+parse_list(const char *s)
+{
+    vector<npy_intp> values;
+
+    while (*s) {
+        char *end;
+        long value = strtol(s, &end, 10);
+        if (end == s || value <= 0) {
+            break;
+        }
+        values.push_back(value);
+        s = (*end == ',') ? end + 1 : end;
+    }
+    return values;
+}
+
+static void
+usage(const char *prog)
+{
+    fprintf(stderr,
+            "usage: %s [-n elements] [-r repeats] [-b blocks] [-s strides] "
+            "[filter]\n"
+            "  blocks and strides are comma separated lists (block sizes "
+            "up to %d)\n",
+            prog, BLOCK_SIZE1);
+}
+
+int
+main(int argc, char **argv)
+{
+    npy_intp n = 1 << 20;
+    int repeats = 5;
+    vector<npy_intp> blocks, strides;
+    const char *filter = "";
+
+    blocks.push_back(128);
+    blocks.push_back(1024);
+    if (BLOCK_SIZE1 != 1024) {
+        blocks.push_back(BLOCK_SIZE1);
+    }
+    strides.push_back(1);
+    strides.push_back(2);
+
+    for (int i = 1; i < argc; i++) {
+        if (argv[i][0] != '-') {
+            filter = argv[i];
+        }
+        else if (i + 1 < argc && strcmp(argv[i], "-n") == 0) {
+            n = atol(argv[++i]);
+        }
+        else if (i + 1 < argc && strcmp(argv[i], "-r") == 0) {
+            repeats = atoi(argv[++i]);
+        }
+        else if (i + 1 < argc && strcmp(argv[i], "-b") == 0) {
+            blocks = parse_list(argv[++i]);
+        }
+        else if (i + 1 < argc && strcmp(argv[i], "-s") == 0) {
+            strides = parse_list(argv[++i]);
+        }
+        else {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+    if (n <= 0 || repeats <= 0 || blocks.empty() || strides.empty()) {
+        usage(argv[0]);
+        return 2;
+    }
+    for (size_t i = 0; i < blocks.size(); i++) {
+        if (blocks[i] > BLOCK_SIZE1) {
+            // Constants only take blocks of BLOCK_SIZE1 elements
+            usage(argv[0]);
+            return 2;
+        }
+    }
+
+    Py_Initialize();
+    // Set up NumPy (and the module state) like importing numexpr does
+#if PY_MAJOR_VERSION >= 3
+    PyObject *module = PyInit_interpreter();
+    if (module == NULL) {
+#else
+    initinterpreter();
+    if (PyErr_Occurred()) {
+#endif
+        PyErr_Print();
+        return 1;
+    }
+
+    vector<bench_case> cases;
+    add_opcode_cases(&cases);
+    add_program_cases(&cases);
+
+    printf("# %ld elements, best of %d runs\n", (long)n, repeats);
+    printf("%-32s %-5s %6s %6s %10s %8s\n",
+           "case", "sig", "block", "stride", "ns/elem", "GB/s");
+    int errors = 0;
+    for (size_t i = 0; i < cases.size(); i++) {
+        const bench_case &c = cases[i];
+        if (strstr(c.name.c_str(), filter) == NULL) {
+            continue;
+        }
+        // The bytes of the operands and of the outcome, per element
+        npy_intp bytes = 0;
+        for (size_t k = c.reduction ? 1 : 0; k < c.sig.size(); k++) {
+            PyArray_Descr *dtype = bench_dtype(c.sig[k]);
+            bytes += dtype->elsize;
+            Py_DECREF(dtype);
+        }
+        for (size_t b = 0; b < blocks.size(); b++) {
+            for (size_t s = 0; s < strides.size(); s++) {
+                double best;
+                printf("%-32s %-5s %6ld %6ld ", c.name.c_str(),
+                       c.sig.c_str(), (long)blocks[b], (long)strides[s]);
+                if (run_case(c, n, blocks[b], (int)strides[s], repeats,
+                             &best) < 0) {
+                    printf("%10s %8s\n", "error", "-");
+                    PyErr_Print();
+                    errors++;
+                    continue;
+                }
+                printf("%10.3f %8.2f\n", best * 1e9 / n,
+                       bytes * n / best * 1e-9);
+                fflush(stdout);
+            }
+        }
+    }
+
+#if PY_MAJOR_VERSION >= 3
+    Py_DECREF(module);
+#endif
+    Py_Finalize();
+    return errors ? 1 : 0;
+}
@@ -38,11 +38,25 @@ else:
 import os, os.path
 import platform
 from numexpr.expressions import E
-from numexpr.necompiler import NumExpr, disassemble, evaluate
+from numexpr.necompiler import (
+    NumExpr, disassemble, evaluate, profile, perf_counters, memory_usage)
+from numexpr.chunked import evaluate_chunked, iterevaluate, FileArray
+from numexpr.carray import CArray
+from numexpr.incremental import Incremental
+from numexpr.records import evaluate_records
+from numexpr.tiled import evaluate_tiled
+from numexpr.sparse import evaluate_sparse, preserves_zero
+from numexpr.cost import analyze
 from numexpr.tests import test, print_versions
 from numexpr.utils import (
     get_vml_version, set_vml_accuracy_mode, set_vml_num_threads,
-    set_num_threads, detect_number_of_cores, detect_number_of_threads)
+    set_num_threads, detect_number_of_cores, detect_number_of_threads,
+    set_result_cache_size, mark_modified, set_profiling, set_timing,
+    get_timings, dump_timings, get_thread_stats, set_perf_counters,
+    perf_counters_available, get_thread_perf_counters, set_memory_cap,
+    get_memory_usage, set_scheduler, get_scheduler, schedulers,
+    set_vml_auto_threads, set_pipelined_buffering, set_isa_level,
+    get_isa_level, detect_isa_level, isa_levels)
 
 # Detect the number of cores
 ncores = detect_number_of_cores()
@@ -63,6 +77,9 @@ else:
 # The default for VML is 1 thread (see #39)
 set_vml_num_threads(1)
 
+# Select the engines of the ISA level in NUMEXPR_ISA, if any
+set_isa_level(detect_isa_level())
+
 import version
 
 dirname = os.path.dirname(__file__)
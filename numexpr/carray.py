@@ -0,0 +1,160 @@
+###################################################################
+#  Numexpr - Fast numerical array expression evaluator for NumPy.
+#
+#      License: MIT
+#      Author:  See AUTHORS.txt
+#
+#  See LICENSE.txt and LICENSES/*.txt for details about copyright and
+#  rights to use.
+####################################################################
+
+"""
+Compressed in-memory arrays that can be used as operands of expressions.
+
+The data is kept as compressed blocks of rows.  During evaluation, each
+block is decompressed into a small buffer (about the size of a L2 cache)
+right before the virtual machine computes on it, so the full operand is
+never decompressed in memory.
+"""
+
+import numpy
+
+from numexpr import interpreter
+from numexpr.chunked import ArraySource, _row_nbytes
+
+# The default size (in bytes) of the uncompressed blocks
+BLOCK_BYTES = 256 * 2 ** 10
+
+
+class CArray(object):
+    """A compressed array, stored in memory as blocks of rows.
+
+    Parameters
+    ----------
+
+    array : array_like
+        The data to be compressed.  It cannot be 0-dimensional.
+
+    blocklen : int, optional
+        The number of rows in each block.  By default, blocks of about
+        `BLOCK_BYTES` are used.
+
+    shuffle : bool, optional
+        Whether the bytes of the elements are shuffled before compressing
+        them (True by default).  This usually improves the compression
+        ratio of numerical data.
+    """
+
+    def __init__(self, array, blocklen=None, shuffle=True):
+        array = numpy.ascontiguousarray(array)
+        if array.ndim == 0:
+            raise ValueError("0-dimensional arrays cannot be compressed")
+        if array.dtype.hasobject:
+            raise ValueError("object arrays cannot be compressed")
+        self.dtype = array.dtype
+        self.shape = array.shape
+        rowbytes = _row_nbytes(self.shape, self.dtype)
+        if blocklen is None:
+            blocklen = max(1, BLOCK_BYTES // max(rowbytes, 1))
+        self.blocklen = int(blocklen)
+        self.blocks = [interpreter._compress(array[i:i + self.blocklen],
+                                             shuffle)
+                       for i in range(0, len(array), self.blocklen)]
+
+    @property
+    def ndim(self):
+        return len(self.shape)
+
+    @property
+    def nbytes(self):
+        """The size of the uncompressed data."""
+        return _row_nbytes((1,) + self.shape, self.dtype)
+
+    @property
+    def cbytes(self):
+        """The size of the compressed data."""
+        return sum(len(block) for block in self.blocks)
+
+    def __len__(self):
+        return self.shape[0]
+
+    def __repr__(self):
+        return "CArray(shape=%s, dtype=%s, nbytes=%d, cbytes=%d)" % (
+            self.shape, self.dtype, self.nbytes, self.cbytes)
+
+    def block_range(self, i):
+        """The range of rows of block `i`."""
+        start = i * self.blocklen
+        return start, min(start + self.blocklen, self.shape[0])
+
+    def decompress_block(self, i, out=None):
+        """Decompress block `i` into `out` (allocated if None)."""
+        start, stop = self.block_range(i)
+        if out is None:
+            out = numpy.empty((stop - start,) + self.shape[1:],
+                              dtype=self.dtype)
+        interpreter._decompress(self.blocks[i], out)
+        return out
+
+    def __array__(self, dtype=None):
+        out = numpy.empty(self.shape, dtype=self.dtype)
+        for i in range(len(self.blocks)):
+            self.decompress_block(i, out[slice(*self.block_range(i))])
+        if dtype is not None:
+            out = out.astype(dtype)
+        return out
+
+    def chunk_source(self, nrows, ndim):
+        return CArraySource(self, nrows, ndim)
+
+
+class CArraySource(ArraySource):
+    """Chunk source decompressing the blocks of a `CArray` on demand.
+
+    The preferred chunk length is the block length, so that every chunk
+    is decompressed straight into a single reused buffer.
+    """
+
+    def __init__(self, carray, nrows, ndim):
+        self.carray = carray
+        self.dtype = carray.dtype
+        self.split = (carray.ndim == ndim and ndim > 0 and
+                      carray.shape[0] == nrows and nrows != 1)
+        self.advise = False
+        self.chunklen = carray.blocklen if self.split else None
+        self.buffer = None
+        self.scratch = None
+        self.whole = None
+
+    def _buffer(self, nrows):
+        if self.buffer is None or len(self.buffer) < nrows:
+            self.buffer = numpy.empty((nrows,) + self.carray.shape[1:],
+                                      dtype=self.dtype)
+        return self.buffer[:nrows]
+
+    def chunk(self, start, stop):
+        carray = self.carray
+        if not self.split:
+            if self.whole is None:
+                self.whole = numpy.asarray(carray)
+            return self.whole
+        out = self._buffer(stop - start)
+        row = start
+        while row < stop:
+            i = row // carray.blocklen
+            bstart, bstop = carray.block_range(i)
+            if row == bstart and bstop <= stop:
+                carray.decompress_block(i, out[row - start:bstop - start])
+                row = bstop
+            else:
+                # Only a part of the block is needed
+                if self.scratch is None:
+                    self.scratch = numpy.empty(
+                        (carray.blocklen,) + carray.shape[1:],
+                        dtype=self.dtype)
+                block = carray.decompress_block(
+                    i, self.scratch[:bstop - bstart])
+                end = min(bstop, stop)
+                out[row - start:end - start] = block[row - bstart:end - bstart]
+                row = end
+        return out
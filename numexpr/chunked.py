@@ -0,0 +1,755 @@
+###################################################################
+#  Numexpr - Fast numerical array expression evaluator for NumPy.
+#
+#      License: MIT
+#      Author:  See AUTHORS.txt
+#
+#  See LICENSE.txt and LICENSES/*.txt for details about copyright and
+#  rights to use.
+####################################################################
+
+"""
+Evaluation of expressions in chunks along the leading dimension.
+
+This is meant for operands that are too large to be processed in one
+go, like memory mapped arrays much larger than the available RAM.
+Each chunk is computed by the regular (multi-threaded) virtual
+machine, while the OS is told which parts of the operands are going
+to be needed next and which ones can be dropped.
+"""
+
+import os
+import threading
+import Queue
+from io import BytesIO
+
+import numpy
+from numpy.lib import format as npformat
+
+from numexpr import interpreter
+from numexpr.necompiler import (
+    getContext, getCachedExprNames, getArguments, getCachedNumExpr,
+    disassemble)
+
+# The default size (in bytes) of the operands and output for a chunk
+CHUNK_BYTES = 64 * 2 ** 20
+# The default amount of output (in chunks) that may be dirty in memory
+DIRTY_CHUNKS = 4
+
+
+def _is_shared_memmap(a):
+    """Whether pages of `a` can be dropped without losing data."""
+    # Copy-on-write ('c') maps are private: dropping would lose changes
+    return (isinstance(a, numpy.memmap) and
+            getattr(a, '_mmap', None) is not None and
+            getattr(a, 'mode', 'c') != 'c')
+
+
+class ArraySource(object):
+    """Chunk source for an in-memory or memory mapped array.
+
+    Operands that do not extend along the leading dimension of the
+    result (scalars or broadcast arrays) are handed out entirely for
+    every chunk.
+    """
+
+    def __init__(self, array, nrows, ndim):
+        self.array = array
+        self.dtype = array.dtype
+        self.split = (array.ndim == ndim and ndim > 0 and
+                      array.shape[0] == nrows and nrows != 1)
+        self.advise = self.split and _is_shared_memmap(array)
+
+    def chunk(self, start, stop):
+        if self.split:
+            return numpy.asarray(self.array[start:stop])
+        return numpy.asarray(self.array)
+
+    def prefetch(self, start, stop):
+        if self.advise:
+            interpreter._madvise(
+                numpy.asarray(self.array[start:stop]), 'willneed')
+
+    def release(self, start, stop):
+        if self.advise:
+            interpreter._madvise(
+                numpy.asarray(self.array[start:stop]), 'dontneed')
+
+    def close(self):
+        pass
+
+
+class ArraySink(object):
+    """Chunk sink writing into an in-memory or memory mapped array.
+
+    For (shared) memory mapped outputs, the written chunks are synced
+    to disk and dropped from memory as soon as more than `max_dirty`
+    bytes are pending, so that the dirty memory stays bounded.
+    """
+
+    def __init__(self, array, max_dirty):
+        self.array = array
+        self.max_dirty = max_dirty
+        self.rowbytes = _row_nbytes(array.shape, array.dtype)
+        self.advise = _is_shared_memmap(array)
+        self.flushed = 0
+
+    def chunk(self, start, stop):
+        return numpy.asarray(self.array[start:stop])
+
+    def commit(self, start, stop):
+        if self.advise and \
+                (stop - self.flushed) * self.rowbytes >= self.max_dirty:
+            self._flush(stop)
+
+    def _flush(self, stop):
+        dirty = numpy.asarray(self.array[self.flushed:stop])
+        interpreter._madvise(dirty, 'sync')
+        interpreter._madvise(dirty, 'dontneed')
+        self.flushed = stop
+
+    def close(self):
+        if self.advise and self.flushed < len(self.array):
+            self._flush(len(self.array))
+
+
+class _IORequest(object):
+    def __init__(self, func, fd, buf, offset):
+        self.func = func
+        self.fd = fd
+        self.buf = buf
+        self.offset = offset
+        self.result = self.error = None
+        self.done = threading.Event()
+
+    def wait(self):
+        """Wait for the request and return the number of bytes moved."""
+        self.done.wait()
+        if self.error is not None:
+            raise self.error
+        return self.result
+
+
+class _IOThread(object):
+    """A thread doing the positional reads or writes of a stream.
+
+    The GIL is released during the actual I/O, so this overlaps with
+    the computations of the virtual machine.
+    """
+
+    def __init__(self):
+        self.requests = Queue.Queue()
+        self.thread = threading.Thread(target=self._work)
+        self.thread.daemon = True
+        self.thread.start()
+
+    def _work(self):
+        while True:
+            req = self.requests.get()
+            if req is None:
+                break
+            try:
+                req.result = req.func(req.fd, req.buf, req.offset)
+            except Exception as e:
+                req.error = e
+            req.done.set()
+
+    def submit(self, func, fd, buf, offset):
+        req = _IORequest(func, fd, buf, offset)
+        self.requests.put(req)
+        return req
+
+    def close(self):
+        """Finish the pending requests and stop the thread."""
+        self.requests.put(None)
+        self.thread.join()
+
+
+class FileArray(object):
+    """An array stored in a .npy or raw binary file.
+
+    Instances can be used as operands of `evaluate()` and
+    `evaluate_chunked()`, as well as their `out` parameter.  The file
+    is then streamed through the virtual machine in chunks of rows, with
+    a background thread reading the next chunk (or writing the previous
+    one) while the current one is computed, instead of mapping the
+    whole file in memory.
+
+    Parameters
+    ----------
+
+    filename : str
+        The name of the file.
+
+    dtype, shape : optional
+        For reading raw files, the type of the data (mandatory) and its
+        shape (a 1-d array spanning all the file by default).  For
+        writing, they are taken from the outcome by default.
+
+    offset : int, optional
+        The position of the data in raw files.
+
+    raw : bool, optional
+        Whether the file is raw binary data (True) or a .npy file
+        (False, the default).
+
+    mode : {'r', 'w'}, optional
+        Whether the file is going to be read (the default) or written.
+    """
+
+    def __init__(self, filename, dtype=None, shape=None, offset=0,
+                 raw=False, mode='r'):
+        if mode not in ('r', 'w'):
+            raise ValueError("mode must be either 'r' or 'w'")
+        self.filename = filename
+        self.mode = mode
+        self.raw = raw
+        self.offset = offset
+        self.dtype = numpy.dtype(dtype) if dtype is not None else None
+        self.shape = tuple(shape) if shape is not None else None
+        if mode == 'r':
+            if raw:
+                self._init_raw()
+            else:
+                self._init_npy()
+
+    def _init_raw(self):
+        if self.dtype is None:
+            raise ValueError("the dtype of raw files must be given")
+        if self.shape is None:
+            size = os.path.getsize(self.filename) - self.offset
+            self.shape = (size // self.dtype.itemsize,)
+
+    def _init_npy(self):
+        f = open(self.filename, 'rb')
+        try:
+            version = npformat.read_magic(f)
+            if version == (1, 0):
+                shape, fortran_order, dtype = npformat.read_array_header_1_0(f)
+            else:
+                shape, fortran_order, dtype = npformat.read_array_header_2_0(f)
+            self.offset = f.tell()
+        finally:
+            f.close()
+        if fortran_order:
+            raise ValueError("Fortran ordered .npy files are not supported")
+        if dtype.hasobject:
+            raise ValueError("object arrays cannot be streamed")
+        self.dtype, self.shape = dtype, shape
+
+    @property
+    def ndim(self):
+        return len(self.shape)
+
+    def __len__(self):
+        return self.shape[0]
+
+    def chunk_source(self, nrows, ndim):
+        if self.mode != 'r':
+            raise ValueError("'%s' is not opened for reading" % self.filename)
+        return FileSource(self, nrows, ndim)
+
+    def chunk_sink(self, shape, dtype, max_dirty=None):
+        if self.mode != 'w':
+            raise ValueError("'%s' is not opened for writing" % self.filename)
+        if self.shape is not None and self.shape != tuple(shape):
+            raise ValueError("the shape of '%s' does not match the outcome"
+                             % self.filename)
+        self.shape = tuple(shape)
+        if self.dtype is None:
+            self.dtype = numpy.dtype(dtype)
+        return FileSink(self)
+
+    def read(self):
+        """Read all the data in memory (mainly for small files)."""
+        out = numpy.empty(self.shape, dtype=self.dtype)
+        fd = _open(self.filename, os.O_RDONLY)
+        try:
+            if interpreter._pread(fd, out, self.offset) != out.nbytes:
+                raise IOError("unexpected end of file in '%s'" % self.filename)
+        finally:
+            os.close(fd)
+        return out
+
+
+def _open(filename, flags):
+    return os.open(filename, flags | getattr(os, 'O_BINARY', 0), 0o666)
+
+
+class _Buffers(object):
+    """A pool of chunk buffers for file streams."""
+
+    def __init__(self, shape, dtype, nbuffers):
+        self.rowshape = tuple(shape[1:])
+        self.dtype = dtype
+        self.free = []
+        self.nfree = nbuffers
+
+    def get(self, nrows):
+        """Get a buffer for `nrows` rows (None if all of them are busy)."""
+        if self.nfree == 0:
+            return None
+        self.nfree -= 1
+        while self.free:
+            base = self.free.pop()
+            if len(base) >= nrows:
+                return base[:nrows]
+        return numpy.empty((nrows,) + self.rowshape, dtype=self.dtype)
+
+    def put(self, buf):
+        self.nfree += 1
+        self.free.append(buf.base if buf.base is not None else buf)
+
+
+class FileSource(object):
+    """Chunk source reading a `FileArray` with a background thread.
+
+    Up to `nbuffers` chunks are in flight (being read or computed)
+    at the same time, so the next chunk is read while the current one
+    is computed (double buffering).
+    """
+
+    def __init__(self, farray, nrows, ndim, nbuffers=2):
+        self.farray = farray
+        self.dtype = farray.dtype
+        self.split = (farray.ndim == ndim and ndim > 0 and
+                      farray.shape[0] == nrows and nrows != 1)
+        self.rowbytes = _row_nbytes(farray.shape, farray.dtype)
+        self.fd = _open(farray.filename, os.O_RDONLY)
+        self.buffers = _Buffers(farray.shape, farray.dtype, nbuffers)
+        self.io = None
+        self.pending = {}
+        self.current = {}
+        self.whole = None
+
+    def _check(self, buf, nread):
+        if nread != buf.nbytes:
+            raise IOError("unexpected end of file in '%s'"
+                          % self.farray.filename)
+        return buf
+
+    def prefetch(self, start, stop):
+        if not self.split or (start, stop) in self.pending:
+            return
+        buf = self.buffers.get(stop - start)
+        if buf is None:
+            return
+        if self.io is None:
+            self.io = _IOThread()
+        offset = self.farray.offset + start * self.rowbytes
+        self.pending[(start, stop)] = (
+            buf, self.io.submit(interpreter._pread, self.fd, buf, offset))
+
+    def chunk(self, start, stop):
+        if not self.split:
+            if self.whole is None:
+                buf = numpy.empty(self.farray.shape, dtype=self.dtype)
+                nread = interpreter._pread(self.fd, buf, self.farray.offset)
+                self.whole = self._check(buf, nread)
+            return self.whole
+        if (start, stop) not in self.pending:
+            self.prefetch(start, stop)
+        if (start, stop) in self.pending:
+            buf, req = self.pending.pop((start, stop))
+            self.current[(start, stop)] = buf
+            return self._check(buf, req.wait())
+        # All the buffers are busy, so do a synchronous read
+        buf = numpy.empty((stop - start,) + self.farray.shape[1:],
+                          dtype=self.dtype)
+        offset = self.farray.offset + start * self.rowbytes
+        return self._check(buf, interpreter._pread(self.fd, buf, offset))
+
+    def release(self, start, stop):
+        buf = self.current.pop((start, stop), None)
+        if buf is not None:
+            self.buffers.put(buf)
+
+    def close(self):
+        if self.io is not None:
+            self.io.close()
+            self.io = None
+        if self.fd is not None:
+            os.close(self.fd)
+            self.fd = None
+
+
+class FileSink(object):
+    """Chunk sink writing a `FileArray` with a background thread.
+
+    Computed chunks are written while the next ones are computed, with
+    up to `nbuffers` chunks in flight.
+    """
+
+    def __init__(self, farray, nbuffers=2):
+        self.array = farray
+        self.rowbytes = _row_nbytes(farray.shape, farray.dtype)
+        flags = os.O_WRONLY | os.O_CREAT
+        if not farray.raw:
+            flags |= os.O_TRUNC
+        self.fd = _open(farray.filename, flags)
+        if not farray.raw:
+            self._write_header()
+        self.buffers = _Buffers(farray.shape, farray.dtype, nbuffers)
+        self.io = _IOThread()
+        self.current = {}
+        self.writing = []
+
+    def _write_header(self):
+        f = BytesIO()
+        npformat.write_array_header_1_0(f, {
+            'descr': npformat.dtype_to_descr(self.array.dtype),
+            'fortran_order': False,
+            'shape': self.array.shape})
+        header = f.getvalue()
+        # Old NumPy versions do not write the magic string here
+        if not header.startswith(npformat.MAGIC_PREFIX):
+            header = npformat.magic(1, 0) + header
+        buf = numpy.frombuffer(header, dtype=numpy.uint8)
+        interpreter._pwrite(self.fd, buf, 0)
+        self.array.offset = len(header)
+
+    def _wait_oldest(self):
+        buf, req = self.writing.pop(0)
+        if req.wait() != buf.nbytes:
+            raise IOError("short write in '%s'" % self.array.filename)
+        self.buffers.put(buf)
+
+    def chunk(self, start, stop):
+        buf = self.buffers.get(stop - start)
+        while buf is None:
+            self._wait_oldest()
+            buf = self.buffers.get(stop - start)
+        self.current[(start, stop)] = buf
+        return buf
+
+    def commit(self, start, stop):
+        buf = self.current.pop((start, stop))
+        offset = self.array.offset + start * self.rowbytes
+        self.writing.append(
+            (buf, self.io.submit(interpreter._pwrite, self.fd, buf, offset)))
+
+    def close(self):
+        try:
+            while self.writing:
+                self._wait_oldest()
+        finally:
+            self.io.close()
+            os.close(self.fd)
+
+
+class CallbackSink(object):
+    """Chunk sink handing each computed chunk to `callback`.
+
+    `callback` is called as ``callback(start, stop, chunk)`` for every
+    chunk of rows, in order.  The chunk buffer is reused afterwards, so
+    it has to be copied if it is going to be kept.
+    """
+
+    def __init__(self, callback, shape, dtype):
+        self.array = None
+        self.callback = callback
+        self.buffers = _Buffers(shape, dtype, 1)
+
+    def chunk(self, start, stop):
+        self.buf = self.buffers.get(stop - start)
+        return self.buf
+
+    def commit(self, start, stop):
+        try:
+            self.callback(start, stop, self.buf)
+        finally:
+            self.buffers.put(self.buf)
+
+    def close(self):
+        pass
+
+
+def _row_nbytes(shape, dtype):
+    n = dtype.itemsize
+    for dim in shape[1:]:
+        n *= dim
+    return n
+
+
+def _check_elementwise(compiled_ex):
+    op = disassemble(compiled_ex)[-1][0]
+    if op.startswith(b'sum_') or op.startswith(b'prod_'):
+        raise NotImplementedError(
+            "reductions cannot be evaluated in chunks")
+
+
+class ChunkedEvaluator(object):
+    """Drive the evaluation of an expression over chunks of rows.
+
+    `sources` is a list of chunk sources (one per input name) and
+    `shape` the broadcast shape of the result.
+    """
+
+    def __init__(self, ex, names, sources, shape, context, expr_key,
+                 ex_uses_vml, chunklen=None, order='K', casting='safe'):
+        self.ex = ex
+        self.names = names
+        self.sources = sources
+        self.shape = shape
+        self.nrows = shape[0] if shape else 1
+        self.context = context
+        self.expr_key = expr_key
+        self.ex_uses_vml = ex_uses_vml
+        self.order = order
+        self.casting = casting
+        self.compiled_ex = None
+        if chunklen is None:
+            # Sources with a natural chunk length (e.g. compressed blocks)
+            hints = [s.chunklen for s in sources
+                     if getattr(s, 'chunklen', None)]
+            if hints:
+                chunklen = min(hints)
+        if chunklen is None:
+            rowbytes = sum(_row_nbytes(shape, s.dtype)
+                           for s in sources if s.split)
+            # Account for the output too (assume it is a double)
+            rowbytes += _row_nbytes(shape, numpy.dtype(numpy.double))
+            chunklen = max(1, CHUNK_BYTES // max(rowbytes, 1))
+        self.chunklen = int(chunklen)
+
+    def ranges(self):
+        for start in range(0, self.nrows, self.chunklen):
+            yield start, min(start + self.chunklen, self.nrows)
+
+    def compute(self, start, stop, out=None):
+        """Compute rows [start, stop) into `out` (allocated if None)."""
+        arguments = [s.chunk(start, stop) for s in self.sources]
+        if self.compiled_ex is None:
+            self.compiled_ex = getCachedNumExpr(
+                self.ex, self.expr_key, self.names, arguments, self.context)
+            _check_elementwise(self.compiled_ex)
+        kwargs = {'out': out, 'order': self.order, 'casting': self.casting,
+                  'ex_uses_vml': self.ex_uses_vml}
+        return self.compiled_ex(*arguments, **kwargs)
+
+    def _iter(self, out_for):
+        """Yield the (start, stop, chunk) of all the chunks in order.
+
+        `out_for(start, stop)` returns where to store each chunk (None
+        for allocating a new array).
+        """
+        ranges = list(self.ranges())
+        try:
+            for i, (start, stop) in enumerate(ranges):
+                if i == 0:
+                    for s in self.sources:
+                        s.prefetch(start, stop)
+                # Tell the OS to bring in the next chunk while we work
+                if i + 1 < len(ranges):
+                    for s in self.sources:
+                        s.prefetch(*ranges[i + 1])
+                yield start, stop, self.compute(start, stop,
+                                                out=out_for(start, stop))
+                for s in self.sources:
+                    s.release(start, stop)
+        finally:
+            for s in self.sources:
+                s.close()
+
+    def run(self, sink=None, sink_factory=None):
+        """Evaluate all the chunks, writing them to `sink`.
+
+        If `sink` is None, `sink_factory` is called with the first
+        computed chunk (so that the output type is known) and must
+        return the chunk sink.  The sink is returned.
+        """
+        def out_for(start, stop):
+            if sink is None:
+                return None
+            return sink.chunk(start, stop)
+
+        chunks = self._iter(out_for)
+        try:
+            for start, stop, chunk in chunks:
+                if sink is None:
+                    sink = sink_factory(chunk)
+                    sink.chunk(start, stop)[...] = chunk
+                sink.commit(start, stop)
+        finally:
+            chunks.close()
+            if sink is not None:
+                sink.close()
+        return sink
+
+    def iterate(self, nbuffers=2):
+        """Yield the chunks of the outcome, reusing `nbuffers` buffers."""
+        ring = []
+
+        def out_for(start, stop):
+            i = (start // self.chunklen) % nbuffers
+            if i < len(ring):
+                return ring[i][:stop - start]
+            return None
+
+        for start, stop, chunk in self._iter(out_for):
+            if len(ring) < nbuffers and len(chunk) == self.chunklen:
+                ring.append(chunk)
+            yield chunk
+
+
+def _broadcast_shape(shapes):
+    ndim = max([len(shape) for shape in shapes] or [0])
+    result = [1] * ndim
+    for shape in shapes:
+        for i, dim in enumerate(shape, ndim - len(shape)):
+            if dim != 1:
+                if result[i] not in (1, dim):
+                    raise ValueError("shape mismatch: objects cannot be "
+                                     "broadcast to a single shape")
+                result[i] = dim
+    return tuple(result)
+
+
+def _is_stream(obj):
+    """Whether `obj` requires the chunked evaluation."""
+    return hasattr(obj, 'chunk_source') or hasattr(obj, 'chunk_sink')
+
+
+def _make_sources(arguments):
+    arrays = [a if isinstance(a, numpy.ndarray) or _is_stream(a)
+              else numpy.asarray(a) for a in arguments]
+    shape = _broadcast_shape([a.shape for a in arrays])
+    nrows = shape[0] if shape else 1
+    sources = []
+    for a in arrays:
+        if hasattr(a, 'chunk_source'):
+            sources.append(a.chunk_source(nrows, len(shape)))
+        else:
+            sources.append(ArraySource(a, nrows, len(shape)))
+    return sources, shape
+
+
+def _make_sink(out, shape, dtype, max_dirty):
+    if hasattr(out, 'chunk_sink'):
+        return out.chunk_sink(shape, dtype, max_dirty)
+    if callable(out):
+        return CallbackSink(out, shape, dtype)
+    return ArraySink(out, max_dirty)
+
+
+def evaluate_chunked(ex, local_dict=None, global_dict=None, out=None,
+                     chunklen=None, max_dirty=None, order='K',
+                     casting='safe', **kwargs):
+    """Evaluate an element-wise expression in chunks of rows.
+
+    This works like `evaluate()`, but the operands are processed in
+    chunks along their leading dimension, which makes it suitable for
+    memory mapped (`numpy.memmap`) operands that are larger than the
+    available memory.  For memory mapped inputs, the OS is asked to
+    read ahead the next chunk while the current one is computed, and
+    to drop the pages of the chunks already processed.  Operands can
+    also be `FileArray` instances, which are streamed from their files
+    by a background thread.
+
+    Parameters
+    ----------
+
+    out : NumPy array, memmap, `FileArray` or callable, optional
+        Where to store the result.  When it is a memory mapped array,
+        the computed chunks are written back to disk and dropped from
+        memory as soon as more than `max_dirty` bytes are pending.  A
+        callable is called as ``out(start, stop, chunk)`` for each
+        chunk of rows instead.
+
+    chunklen : int, optional
+        The number of rows in each chunk.  By default, chunks of
+        roughly `CHUNK_BYTES` (operands and output) are used.
+
+    max_dirty : int, optional
+        The maximum amount of bytes of output kept dirty in memory.
+        It defaults to `DIRTY_CHUNKS` chunks.
+
+    See `evaluate()` for the rest of parameters.  Reductions are not
+    supported.  The outcome is returned, except for callable outputs
+    (None is returned then).
+    """
+    if not isinstance(ex, (str, unicode)):
+        raise ValueError("must specify expression as a string")
+    context = getContext(kwargs, frame_depth=1)
+    expr_key, (names, ex_uses_vml) = getCachedExprNames(ex, context)
+    arguments = getArguments(names, local_dict, global_dict, frame_depth=1)
+    return evaluate_arguments(ex, names, arguments, context, expr_key,
+                              ex_uses_vml, out, chunklen, max_dirty,
+                              order, casting)
+
+
+def evaluate_arguments(ex, names, arguments, context, expr_key, ex_uses_vml,
+                       out=None, chunklen=None, max_dirty=None, order='K',
+                       casting='safe'):
+    """The chunked evaluation of `ex` over already looked up `arguments`."""
+    sources, shape = _make_sources(arguments)
+    evaluator = ChunkedEvaluator(ex, names, sources, shape, context,
+                                 expr_key, ex_uses_vml, chunklen,
+                                 order, casting)
+
+    def make_sink(target, shape, dtype):
+        limit = max_dirty
+        if limit is None:
+            limit = DIRTY_CHUNKS * evaluator.chunklen * _row_nbytes(shape, dtype)
+        return _make_sink(target, shape, dtype, limit)
+
+    if not shape or shape[0] == 0:
+        # Nothing to chunk here
+        try:
+            if out is None or isinstance(out, numpy.ndarray):
+                return evaluator.compute(0, 0, out=out)
+            if not shape:
+                raise ValueError("cannot stream a 0-dimensional outcome")
+            sink = make_sink(out, shape, evaluator.compute(0, 0).dtype)
+            sink.close()
+            return sink.array
+        finally:
+            for s in sources:
+                s.close()
+
+    if isinstance(out, numpy.ndarray):
+        sink = make_sink(out, out.shape, out.dtype)
+        return evaluator.run(sink=sink).array
+    if out is None:
+        sink_factory = lambda first: make_sink(
+            numpy.empty(shape, dtype=first.dtype), shape, first.dtype)
+    else:
+        sink_factory = lambda first: make_sink(out, shape, first.dtype)
+    return evaluator.run(sink_factory=sink_factory).array
+
+
+def iterevaluate(ex, local_dict=None, global_dict=None, chunklen=None,
+                 nbuffers=2, order='K', casting='safe', **kwargs):
+    """Evaluate an element-wise expression, yielding the outcome in chunks.
+
+    This works like `evaluate_chunked()`, but instead of storing the
+    outcome, an iterator over chunks of (at most) `chunklen` rows of
+    it is returned, so that it can be consumed without materializing
+    the whole outcome in memory.  Outcomes without rows are yielded as
+    a single chunk.
+
+    The chunks are computed in a ring of `nbuffers` buffers, so a
+    yielded chunk is overwritten `nbuffers` iterations later; copy it
+    if it has to be kept for longer.
+
+    See `evaluate_chunked()` for the rest of parameters.
+    """
+    if not isinstance(ex, (str, unicode)):
+        raise ValueError("must specify expression as a string")
+    if nbuffers < 1:
+        raise ValueError("nbuffers must be at least 1")
+    # Look up the operands now, as the caller frame is not known later
+    context = getContext(kwargs, frame_depth=1)
+    expr_key, (names, ex_uses_vml) = getCachedExprNames(ex, context)
+    arguments = getArguments(names, local_dict, global_dict, frame_depth=1)
+    sources, shape = _make_sources(arguments)
+    evaluator = ChunkedEvaluator(ex, names, sources, shape, context,
+                                 expr_key, ex_uses_vml, chunklen,
+                                 order, casting)
+    if not shape or shape[0] == 0:
+        try:
+            return iter([evaluator.compute(0, 0)])
+        finally:
+            for s in sources:
+                s.close()
+    return evaluator.iterate(nbuffers)
@@ -0,0 +1,277 @@
+// Numexpr - Fast numerical array expression evaluator for NumPy.
+//
+//      License: MIT
+//      Author:  See AUTHORS.txt
+//
+//  See LICENSE.txt for details about copyright and rights to use.
+//
+// codec.cpp contains the compressor for the blocks of compressed arrays.
+
+#include "module.hpp"
+#include <string.h>
+
+#include "codec.hpp"
+
+// Parameters of the LZ4 block format
+#define MINMATCH 4
+#define LASTLITERALS 5      // the last bytes are always literals
+#define MFLIMIT 12          // no match can start in the last bytes
+#define MAX_DISTANCE 65535
+#define HASH_LOG 12
+
+typedef unsigned char uchar;
+
+static inline npy_uint32
+read32(const uchar *p)
+{
+    npy_uint32 v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline npy_uint32
+hash32(npy_uint32 v)
+{
+    return (v * 2654435761U) >> (32 - HASH_LOG);
+}
+
+// Encode the remainder of a length after its 4 bits in the token
+static inline uchar *
+write_length(uchar *op, size_t len)
+{
+    while (len >= 255) {
+        *op++ = 255;
+        len -= 255;
+    }
+    *op++ = (uchar)len;
+    return op;
+}
+
+size_t
+nx_compress_bound(size_t n)
+{
+    return n + n / 255 + 16;
+}
+
+size_t
+nx_lz4_compress(const char *source, size_t n, char *dest, size_t capacity)
+{
+    const uchar *src = (const uchar *)source;
+    const uchar *ip = src, *anchor = src;
+    const uchar *iend = src + n;
+    uchar *op = (uchar *)dest, *oend = op + capacity;
+    size_t litlen;
+    npy_uint32 table[1 << HASH_LOG];
+
+    if (n > MFLIMIT) {
+        const uchar *mflimit = iend - MFLIMIT;
+        const uchar *matchlimit = iend - LASTLITERALS;
+        memset(table, 0, sizeof(table));
+        ip++;
+        while (ip <= mflimit) {
+            npy_uint32 seq = read32(ip);
+            npy_uint32 h = hash32(seq);
+            const uchar *ref = src + table[h];
+            table[h] = (npy_uint32)(ip - src);
+            if (ref >= ip || ip - ref > MAX_DISTANCE || read32(ref) != seq) {
+                ip++;
+                continue;
+            }
+            // Extend the match backwards and then forwards
+            while (ip > anchor && ref > src && ip[-1] == ref[-1]) {
+                ip--;
+                ref--;
+            }
+            const uchar *mp = ip + MINMATCH, *rp = ref + MINMATCH;
+            while (mp < matchlimit && *mp == *rp) {
+                mp++;
+                rp++;
+            }
+            size_t mlen = mp - ip - MINMATCH;
+            size_t offset = ip - ref;
+            litlen = ip - anchor;
+            if ((size_t)(oend - op) <
+                    1 + litlen / 255 + 1 + litlen + 2 + mlen / 255 + 1) {
+                return 0;
+            }
+            uchar *token = op++;
+            if (litlen >= 15) {
+                *token = 15 << 4;
+                op = write_length(op, litlen - 15);
+            }
+            else {
+                *token = (uchar)(litlen << 4);
+            }
+            memcpy(op, anchor, litlen);
+            op += litlen;
+            *op++ = (uchar)(offset & 255);
+            *op++ = (uchar)(offset >> 8);
+            if (mlen >= 15) {
+                *token |= 15;
+                op = write_length(op, mlen - 15);
+            }
+            else {
+                *token |= (uchar)mlen;
+            }
+            ip = anchor = mp;
+            // Remember a position inside the match for the next ones
+            table[hash32(read32(ip - 2))] = (npy_uint32)(ip - 2 - src);
+        }
+    }
+
+    // The last sequence only has literals
+    litlen = iend - anchor;
+    if ((size_t)(oend - op) < 1 + litlen / 255 + 1 + litlen) {
+        return 0;
+    }
+    if (litlen >= 15) {
+        *op++ = 15 << 4;
+        op = write_length(op, litlen - 15);
+    }
+    else {
+        *op++ = (uchar)(litlen << 4);
+    }
+    memcpy(op, anchor, litlen);
+    op += litlen;
+    return op - (uchar *)dest;
+}
+
+// Decode the remainder of a length (returns false on overruns)
+static inline bool
+read_length(const uchar **ip, const uchar *iend, size_t *len)
+{
+    uchar s;
+    do {
+        if (*ip >= iend) {
+            return false;
+        }
+        s = *(*ip)++;
+        *len += s;
+    } while (s == 255);
+    return true;
+}
+
+npy_intp
+nx_lz4_decompress(const char *source, size_t csize, char *dest, size_t n)
+{
+    const uchar *ip = (const uchar *)source, *iend = ip + csize;
+    uchar *op = (uchar *)dest, *oend = op + n;
+
+    while (ip < iend) {
+        uchar token = *ip++;
+        size_t len = token >> 4;
+        if (len == 15 && !read_length(&ip, iend, &len)) {
+            return -1;
+        }
+        if (len > (size_t)(iend - ip) || len > (size_t)(oend - op)) {
+            return -1;
+        }
+        if (len <= 16 && iend - ip >= 16 && oend - op >= 16) {
+            // Short literals are copied as a whole chunk
+            memcpy(op, ip, 16);
+        }
+        else {
+            memcpy(op, ip, len);
+        }
+        op += len;
+        ip += len;
+        if (ip == iend) {
+            break;      // the last sequence
+        }
+
+        if (iend - ip < 2) {
+            return -1;
+        }
+        size_t offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+        if (offset == 0 || offset > (size_t)(op - (uchar *)dest)) {
+            return -1;
+        }
+        len = token & 15;
+        if (len == 15 && !read_length(&ip, iend, &len)) {
+            return -1;
+        }
+        len += MINMATCH;
+        if (len > (size_t)(oend - op)) {
+            return -1;
+        }
+        const uchar *match = op - offset;
+        if (offset >= 16 && len <= 32 && (size_t)(oend - op) >= 32) {
+            // Short matches are copied in chunks, overrunning them
+            memcpy(op, match, 16);
+            memcpy(op + 16, match + 16, 16);
+            op += len;
+        }
+        else if (offset == 1) {
+            memset(op, *match, len);
+            op += len;
+        }
+        else {
+            // Overlapping matches are copied in non-overlapping steps
+            while (len > 0) {
+                size_t step = len < offset ? len : offset;
+                memcpy(op, match, step);
+                op += step;
+                match += step;
+                len -= step;
+            }
+        }
+    }
+    return op - (uchar *)dest;
+}
+
+// The loops with a constant type size are much faster, as the compiler
+// can keep the elements in registers
+template <size_t typesize>
+static void
+shuffle_n(size_t nelems, const char *src, char *dst)
+{
+    for (size_t i = 0; i < nelems; i++) {
+        for (size_t j = 0; j < typesize; j++) {
+            dst[j * nelems + i] = src[i * typesize + j];
+        }
+    }
+}
+
+template <size_t typesize>
+static void
+unshuffle_n(size_t nelems, const char *src, char *dst)
+{
+    for (size_t i = 0; i < nelems; i++) {
+        for (size_t j = 0; j < typesize; j++) {
+            dst[i * typesize + j] = src[j * nelems + i];
+        }
+    }
+}
+
+void
+nx_shuffle(size_t typesize, size_t nelems, const char *src, char *dst)
+{
+    switch (typesize) {
+    case 2: shuffle_n<2>(nelems, src, dst); return;
+    case 4: shuffle_n<4>(nelems, src, dst); return;
+    case 8: shuffle_n<8>(nelems, src, dst); return;
+    case 16: shuffle_n<16>(nelems, src, dst); return;
+    }
+    for (size_t j = 0; j < typesize; j++) {
+        for (size_t i = 0; i < nelems; i++) {
+            dst[j * nelems + i] = src[i * typesize + j];
+        }
+    }
+}
+
+void
+nx_unshuffle(size_t typesize, size_t nelems, const char *src, char *dst)
+{
+    switch (typesize) {
+    case 2: unshuffle_n<2>(nelems, src, dst); return;
+    case 4: unshuffle_n<4>(nelems, src, dst); return;
+    case 8: unshuffle_n<8>(nelems, src, dst); return;
+    case 16: unshuffle_n<16>(nelems, src, dst); return;
+    }
+    for (size_t i = 0; i < nelems; i++) {
+        for (size_t j = 0; j < typesize; j++) {
+            dst[i * typesize + j] = src[j * nelems + i];
+        }
+    }
+}
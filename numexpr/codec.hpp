@@ -0,0 +1,41 @@
+#ifndef NUMEXPR_CODEC_HPP
+#define NUMEXPR_CODEC_HPP
+/*********************************************************************
+  Numexpr - Fast numerical array expression evaluator for NumPy.
+
+      License: MIT
+      Author:  See AUTHORS.txt
+
+  See LICENSE.txt for details about copyright and rights to use.
+**********************************************************************/
+
+/* A small and fast codec for the blocks of compressed arrays.
+
+   Blocks are (optionally) byte-shuffled, so that the bytes with the same
+   significance in every element are stored together, and then compressed
+   with a LZ77 compressor producing the LZ4 block format.  Only the
+   functions needed by the compressed containers are implemented. */
+
+#include <stddef.h>
+
+/* Flags in the first byte of a compressed block */
+#define NX_CODEC_SHUFFLE 0x1    /* the data was shuffled */
+#define NX_CODEC_STORED  0x2    /* the data was not compressible */
+#define NX_CODEC_HEADER  1      /* size of the header of a block */
+
+/* Maximum size of the LZ4 compressed form of `n` bytes */
+size_t nx_compress_bound(size_t n);
+
+/* Compress `n` bytes of `src` into `dst` (with room for `capacity`
+   bytes).  Returns the compressed size, or 0 if it does not fit. */
+size_t nx_lz4_compress(const char *src, size_t n, char *dst, size_t capacity);
+
+/* Decompress `csize` bytes of `src` into `dst` (with room for `n`
+   bytes).  Returns the decompressed size, or -1 if `src` is corrupt. */
+npy_intp nx_lz4_decompress(const char *src, size_t csize, char *dst, size_t n);
+
+/* Transpose the bytes of `nelems` elements of `typesize` bytes */
+void nx_shuffle(size_t typesize, size_t nelems, const char *src, char *dst);
+void nx_unshuffle(size_t typesize, size_t nelems, const char *src, char *dst);
+
+#endif // NUMEXPR_CODEC_HPP
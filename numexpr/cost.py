@@ -0,0 +1,196 @@
+###################################################################
+#  Numexpr - Fast numerical array expression evaluator for NumPy.
+#
+#      License: MIT
+#      Author:  See AUTHORS.txt
+#
+#  See LICENSE.txt and LICENSES/*.txt for details about copyright and
+#  rights to use.
+####################################################################
+
+"""
+Cost estimates of the programs run by the VM.
+
+Every instruction of a program is annotated with the bytes it reads and
+writes and the floating point operations it does per element.  As the
+VM works over blocks of `interpreter.block_size` elements, only the
+operands and the outcome move to or from memory; the temporaries stay
+in cache.  Comparing the bytes moved with the operations done gives the
+arithmetic intensity of the expression, and whether it is bound by the
+memory bandwidth or the compute throughput of a machine.
+"""
+
+import numpy
+
+from numexpr import interpreter
+from numexpr.necompiler import (
+    getContext, getCachedExprNames, getArguments, getCachedNumExpr,
+    getCachedVectorNames, asVectors, disassemble)
+from numexpr.chunked import _broadcast_shape
+
+# The size of the elements of every type (strings depend on the operands)
+_itemsizes = {'b': 1, 'i': 4, 'l': 8, 'f': 4, 'd': 8, 'c': 16, 's': 0,
+              'v': 24}
+
+# The floating point operations per element of the instructions, by
+# their name (or by their function).  Transcendental functions count as
+# the operations of a typical polynomial approximation.
+_flops = {
+    'copy': 0, 'ones_like': 0, 'cast': 0, 'real': 0, 'imag': 0,
+    'complex': 0, 'contains': 0,
+    'neg': 1, 'add': 1, 'sub': 1, 'mul': 1, 'div': 1, 'mod': 2,
+    'pow': 20, 'sqrt': 1, 'where': 1, 'invert': 1, 'and': 1, 'or': 1,
+    'gt': 1, 'ge': 1, 'eq': 1, 'ne': 1, 'lshift': 1, 'rshift': 1,
+    'sum': 1, 'prod': 1,
+    'dot': 5, 'norm': 6, 'cross': 9,
+}
+_function_flops = {'absolute': 1, 'conjugate': 1, 'sqrt': 1, 'fmod': 2}
+_transcendental_flops = 20
+
+# How many real operations a complex one takes
+_complex_factor = {'neg': 2, 'add': 2, 'sub': 2, 'mul': 6, 'div': 11,
+                   'eq': 2, 'ne': 2, 'sum': 2, 'prod': 6}
+
+
+def _instruction_flops(name, sig, regs, funcnames):
+    if name == 'func':
+        function = funcnames[regs[sig.index('n')]].rsplit('_', 1)[0]
+        flops = _function_flops.get(function, _transcendental_flops)
+        if 'c' in sig and function != 'conjugate':
+            # Complex functions take several real ones
+            flops *= 4
+        return flops
+    flops = _flops.get(name, 1)
+    if 'c' in sig[1:]:
+        flops = _complex_factor.get(name, flops)
+    return flops
+
+
+def analyze(ex, local_dict=None, global_dict=None, bandwidth=None,
+            flop_rate=None, **kwargs):
+    """Estimate the cost of evaluating an expression.
+
+    `ex` can be an expression string, whose operands are looked up like
+    in `evaluate()` to find its compiled form, or a NumExpr object (for
+    which the size of string operands is unknown, and counted as 0).
+
+    Returns a dictionary with a list of the instructions of the program
+    (under 'instructions') and the totals of the program.  Every
+    instruction is a dictionary with its disassembly ('instruction', see
+    `disassemble()`) and the bytes it reads ('bytes_read') and writes
+    ('bytes_written') and the floating point operations it does
+    ('flops') per element.  The totals are:
+
+      * 'memory_read', 'memory_written': bytes per element moved from
+        and to memory (the operands, read once, and the outcome, which
+        is not streamed by reductions).
+      * 'cache_traffic': bytes per element read and written by all the
+        instructions, mostly in cache.
+      * 'flops': floating point operations per element.
+      * 'temporaries': bytes taken by the temporaries of every thread.
+      * 'intensity': the arithmetic intensity (flops per byte moved
+        from or to memory), or None if no memory is moved.
+      * 'elements': the number of elements of the outcome (None for
+        NumExpr objects).
+
+    If the memory `bandwidth` (in bytes per second) is given, the time
+    per element bound by the memory ('memory_time') is estimated, and
+    if the `flop_rate` (in flops per second) is too, the time bound by
+    the compute ('compute_time') and the expected 'bottleneck'
+    ('memory' or 'compute').  Otherwise they are None.
+    """
+    arguments = None
+    elements = None
+    if isinstance(ex, interpreter.NumExpr):
+        compiled_ex = ex
+    else:
+        context = getContext(kwargs, frame_depth=1)
+        expr_key, (names, _) = getCachedExprNames(ex, context)
+        arguments = [numpy.asarray(a) for a in
+                     getArguments(names, local_dict, global_dict,
+                                  frame_depth=1)]
+        elements = int(numpy.prod(
+            _broadcast_shape([a.shape for a in arguments])))
+        vector_names = getCachedVectorNames(ex, expr_key, context)
+        arguments = [asVectors(a) if name in vector_names else a
+                     for name, a in zip(names, arguments)]
+        compiled_ex = getCachedNumExpr(ex, expr_key, names, arguments,
+                                       context)
+
+    fullsig = compiled_ex.fullsig.decode('ascii')
+    itemsizes = [_itemsizes[t] for t in fullsig]
+    if arguments is not None:
+        # The operands are read with their own types
+        for i, a in enumerate(arguments):
+            itemsizes[1 + i] = a.dtype.itemsize
+        if fullsig[0] == 's':
+            itemsizes[0] = max(a.dtype.itemsize for a in arguments
+                               if a.dtype.char == 'S')
+    r_constants = 1 + len(compiled_ex.signature)
+    r_temps = r_constants + len(compiled_ex.constants)
+    funcnames = dict((code, name.decode('ascii'))
+                     for name, code in interpreter.funccodes.items())
+
+    source = disassemble(compiled_ex)
+    program = bytearray(compiled_ex.program)
+    instructions = []
+    inputs, temps = set(), set()
+    reduction = False
+    for pc, instruction in enumerate(source):
+        if instruction[0] == b'noop':
+            continue
+        name, sig = instruction[0].decode('ascii').rsplit('_', 1)
+        regs = list(program[4 * pc + 1:4 * pc + 4])
+        if pc + 1 < len(source) and source[pc + 1][0] == b'noop':
+            # The arguments that did not fit in the instruction
+            regs += list(program[4 * pc + 5:4 * pc + 8])
+        read = 0
+        # The function codes and axes are not registers
+        for r, t in list(zip(regs, sig))[1:]:
+            if t == 'n':
+                continue
+            if 0 < r < r_constants:
+                inputs.add(r)
+            elif r >= r_temps:
+                temps.add(r)
+            if not r_constants <= r < r_temps:
+                # Constants are scalars, read once per block
+                read += itemsizes[r]
+        if regs[0] >= r_temps:
+            temps.add(regs[0])
+        if name in ('sum', 'prod'):
+            reduction = True
+        instructions.append({
+            'instruction': instruction,
+            'bytes_read': read,
+            'bytes_written': itemsizes[regs[0]],
+            'flops': _instruction_flops(name, sig, regs, funcnames),
+        })
+
+    memory = sum(itemsizes[r] for r in inputs)
+    written = 0 if reduction else itemsizes[0]
+    flops = sum(i['flops'] for i in instructions)
+    moved = memory + written
+    result = {
+        'instructions': instructions,
+        'memory_read': memory,
+        'memory_written': written,
+        'cache_traffic': sum(i['bytes_read'] + i['bytes_written']
+                             for i in instructions),
+        'flops': flops,
+        'temporaries': sum(itemsizes[r] for r in temps) *
+                       interpreter.block_size,
+        'intensity': float(flops) / moved if moved else None,
+        'elements': elements,
+        'memory_time': None,
+        'compute_time': None,
+        'bottleneck': None,
+    }
+    if bandwidth:
+        result['memory_time'] = float(moved) / bandwidth
+    if flop_rate:
+        result['compute_time'] = float(flops) / flop_rate
+    if bandwidth and flop_rate:
+        result['bottleneck'] = ('memory' if result['memory_time'] >=
+                                result['compute_time'] else 'compute')
+    return result
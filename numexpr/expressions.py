@@ -19,6 +19,15 @@ import numpy
 # Declare a double type that does not exist in Python space
 double = numpy.double
 
+
+class vector(object):
+    """The type of 3-vectors of doubles.
+
+    An array of vectors is an array of doubles whose trailing axis, of
+    length 3, is seen as a single element.
+    """
+
+
 # The default kind for undeclared variables
 default_kind = 'double'
 if sys.version_info[0] < 3:
@@ -29,9 +38,11 @@ else:
     long_ = numpy.int64
 
 type_to_kind = {bool: 'bool', int_: 'int', long_: 'long', float: 'float',
-                double: 'double', complex: 'complex', bytes: 'bytes'}
+                double: 'double', complex: 'complex', bytes: 'bytes',
+                vector: 'vector'}
 kind_to_type = {'bool': bool, 'int': int_, 'long': long_, 'float': float,
-                'double': double, 'complex': complex, 'bytes': bytes}
+                'double': double, 'complex': complex, 'bytes': bytes,
+                'vector': vector}
 kind_rank = ['bool', 'int', 'long', 'float', 'double', 'complex', 'none']
 scalar_constant_types = [bool, int_, long, float, double, complex, bytes]
 
@@ -115,6 +126,9 @@ def commonKind(nodes):
         raise TypeError("strings can only be operated with strings")
     if str_count > 0:  # if there are some, all of them must be
         return 'bytes'
+    if 'vector' in node_kinds:
+        raise TypeError("vectors can only be operated with dot(), norm() "
+                        "and cross()")
     n = -1
     for x in nodes:
         n = max(n, kind_rank.index(x.astKind))
@@ -249,6 +263,21 @@ def prod_func(a, axis=None):
     return FuncNode('prod', [a, axis], kind=a.astKind)
 
 
+@ophelper
+def dot_func(a, b):
+    return FuncNode('dot', [a, b], kind='double')
+
+
+@ophelper
+def norm_func(a):
+    return FuncNode('norm', [a], kind='double')
+
+
+@ophelper
+def cross_func(a, b):
+    return FuncNode('cross', [a, b], kind='vector')
+
+
 @ophelper
 def contains_func(a, b):
     return FuncNode('contains', [a, b], kind='bool')
@@ -376,8 +405,16 @@ functions = {
     'sum': sum_func,
     'prod': prod_func,
     'contains': contains_func,
+
+    'dot': dot_func,
+    'norm': norm_func,
+    'cross': cross_func,
 }
 
+# The functions of vectors.  They are only bound when called, as they
+# came later than much of the code using operands of the same names.
+vector_functions = ('dot', 'norm', 'cross')
+
 
 class ExpressionNode(object):
     """An object that represents a generic number object.
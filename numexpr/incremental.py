@@ -0,0 +1,135 @@
+###################################################################
+#  Numexpr - Fast numerical array expression evaluator for NumPy.
+#
+#      License: MIT
+#      Author:  See AUTHORS.txt
+#
+#  See LICENSE.txt and LICENSES/*.txt for details about copyright and
+#  rights to use.
+####################################################################
+
+"""
+Incremental evaluation of expressions over operands that only grow by
+appending rows (like time series).
+"""
+
+import numpy
+
+from numexpr.necompiler import (
+    getContext, getCachedExprNames, getArguments, getCachedNumExpr,
+    disassemble)
+from numexpr.chunked import _broadcast_shape
+
+
+class Incremental(object):
+    """Evaluate an expression over operands that grow by appending rows.
+
+    The handle remembers how many rows of the operands have already been
+    processed, so every `refresh()` only evaluates the rows appended since
+    the previous one.  The rows already processed are assumed not to
+    change.
+
+    For element-wise expressions (and reductions along any axis but the
+    first one), the outcome for the new rows is appended to the previous
+    outcome.  For `sum()` and `prod()` reductions over all the elements
+    or along the first axis, the previous outcome is combined with the
+    one of the new rows.
+
+    Parameters
+    ----------
+
+    ex : str
+        The expression.
+
+    See `evaluate()` for the rest of parameters.
+    """
+
+    def __init__(self, ex, order='K', casting='safe', **kwargs):
+        if not isinstance(ex, (str, unicode)):
+            raise ValueError("must specify expression as a string")
+        self.ex = ex
+        self.order = order
+        self.casting = casting
+        self.context = getContext(kwargs, frame_depth=1)
+        self.expr_key, (self.names, self.ex_uses_vml) = \
+            getCachedExprNames(ex, self.context)
+        self.reset()
+
+    def reset(self):
+        """Forget the rows processed so far."""
+        self.nrows = 0
+        self.reduction = None
+        self.rowwise = False
+        self.buffer = None
+        self.state = None
+
+    def _classify(self, compiled_ex, ndim):
+        """Find out how the outcome for new rows has to be combined."""
+        op, _, _, axis = disassemble(compiled_ex)[-1]
+        if op.startswith(b'sum_'):
+            self.reduction = numpy.add
+        elif op.startswith(b'prod_'):
+            self.reduction = numpy.multiply
+        else:
+            return
+        if axis is not None and axis % ndim != 0:
+            # Each row is reduced on its own
+            self.reduction = None
+            self.rowwise = True
+
+    def refresh(self, local_dict=None, global_dict=None):
+        """Evaluate the rows appended since the previous refresh.
+
+        The operands are looked up like in `evaluate()`.  Returns the
+        outcome for all the rows processed so far.  For element-wise
+        expressions, this is a view of an internal buffer that is only
+        valid until the next refresh.
+        """
+        arguments = [numpy.asarray(a) for a in
+                     getArguments(self.names, local_dict, global_dict,
+                                  frame_depth=1)]
+        shape = _broadcast_shape([a.shape for a in arguments])
+        if not shape:
+            raise ValueError("0-dimensional operands cannot grow")
+        nrows = shape[0]
+        if nrows < self.nrows:
+            raise ValueError("the operands have shrunk since the previous "
+                             "refresh (call reset() to start over)")
+        # Only the new rows of the operands that grow are passed
+        tail = [a[self.nrows:] if a.ndim == len(shape) and
+                a.shape[0] == nrows else a for a in arguments]
+        compiled_ex = getCachedNumExpr(self.ex, self.expr_key, self.names,
+                                       tail, self.context)
+        if self.nrows == 0:
+            self._classify(compiled_ex, len(shape))
+        kwargs = {'order': self.order, 'casting': self.casting,
+                  'ex_uses_vml': self.ex_uses_vml}
+
+        if self.reduction is not None:
+            result = compiled_ex(*tail, **kwargs)
+            if self.state is not None:
+                result = self.reduction(self.state, result)
+            self.state = result
+            self.nrows = nrows
+            return result
+
+        start = self.nrows
+        if self.buffer is None:
+            result = compiled_ex(*tail, **kwargs)
+            self.buffer = numpy.empty((max(2 * nrows, 16),) + result.shape[1:],
+                                      dtype=result.dtype)
+            self.buffer[:nrows] = result
+        else:
+            if nrows > len(self.buffer):
+                # Grow geometrically, so that appending is amortized O(1)
+                buffer = numpy.empty((max(2 * len(self.buffer), nrows),) +
+                                     self.buffer.shape[1:],
+                                     dtype=self.buffer.dtype)
+                buffer[:start] = self.buffer[:start]
+                self.buffer = buffer
+            if self.rowwise:
+                self.buffer[start:nrows] = compiled_ex(*tail, **kwargs)
+            else:
+                compiled_ex(*tail, out=self.buffer[start:nrows], **kwargs)
+        self.nrows = nrows
+        return self.buffer[:nrows]
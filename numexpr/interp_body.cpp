@@ -136,6 +136,10 @@
     // & memsteps[arg[123]] inside the VEC_ARG[123] macros,
     // or you will risk accessing invalid addresses.
 
+    // When profiling, every instruction is charged the time since the
+    // previous one ended
+    npy_uint64 tick = (params.counters != NULL) ? nx_ticks() : 0;
+
     for (pc = 0; pc < params.prog_len; pc += 4) {
         unsigned char op = params.program[pc];
         unsigned int store_in = params.program[pc+1];
@@ -166,6 +170,9 @@
         #define cr_dest ((double *)dest)[2*j]
         #define ci_dest ((double *)dest)[2*j+1]
         #define s_dest ((char *)dest + j*memsteps[store_in])
+        #define vx_dest ((double *)dest)[3*j]
+        #define vy_dest ((double *)dest)[3*j+1]
+        #define vz_dest ((double *)dest)[3*j+2]
         #define b1    ((char   *)(x1+j*sb1))[0]
         #define i1    ((int    *)(x1+j*sb1))[0]
         #define l1    ((long long *)(x1+j*sb1))[0]
@@ -174,6 +181,9 @@
         #define c1r   ((double *)(x1+j*sb1))[0]
         #define c1i   ((double *)(x1+j*sb1))[1]
         #define s1    ((char   *)x1+j*sb1)
+        #define v1x   ((double *)(x1+j*sb1))[0]
+        #define v1y   ((double *)(x1+j*sb1))[1]
+        #define v1z   ((double *)(x1+j*sb1))[2]
         #define b2    ((char   *)(x2+j*sb2))[0]
         #define i2    ((int    *)(x2+j*sb2))[0]
         #define l2    ((long long *)(x2+j*sb2))[0]
@@ -182,6 +192,9 @@
         #define c2r   ((double *)(x2+j*sb2))[0]
         #define c2i   ((double *)(x2+j*sb2))[1]
         #define s2    ((char   *)x2+j*sb2)
+        #define v2x   ((double *)(x2+j*sb2))[0]
+        #define v2y   ((double *)(x2+j*sb2))[1]
+        #define v2z   ((double *)(x2+j*sb2))[2]
         #define b3    ((char   *)(x3+j*sb3))[0]
         #define i3    ((int    *)(x3+j*sb3))[0]
         #define l3    ((long long *)(x3+j*sb3))[0]
@@ -190,8 +203,11 @@
         #define c3r   ((double *)(x3+j*sb3))[0]
         #define c3i   ((double *)(x3+j*sb3))[1]
         #define s3    ((char   *)x3+j*sb3)
+        #define v3x   ((double *)(x3+j*sb3))[0]
+        #define v3y   ((double *)(x3+j*sb3))[1]
+        #define v3z   ((double *)(x3+j*sb3))[2]
         /* Some temporaries */
-        double da, db;
+        double da, db, dc;
         npy_cdouble ca, cb;
 
         switch (op) {
@@ -397,7 +413,10 @@
                                   ci_dest = c1i + c2i);
         case OP_SUB_CCC: VEC_ARG2(cr_dest = c1r - c2r;
                                   ci_dest = c1i - c2i);
-        case OP_MUL_CCC: VEC_ARG2(da = c1r*c2r - c1i*c2i;
+        /* The differences of products are written as sums of negated
+           products, so that compilers do not fuse them into the
+           multiply-add/subtract instructions of AVX-512 (see isa.hpp) */
+        case OP_MUL_CCC: VEC_ARG2(da = c1r*c2r + (-c1i)*c2i;
                                   ci_dest = c1r*c2i + c1i*c2r;
                                   cr_dest = da);
         case OP_DIV_CCC:
@@ -407,7 +426,7 @@
 #else
             VEC_ARG2(da = c2r*c2r + c2i*c2i;
                      db = (c1r*c2r + c1i*c2i) / da;
-                     ci_dest = (c1i*c2r - c1r*c2i) / da;
+                     ci_dest = (c1i*c2r + (-c1r)*c2i) / da;
                      cr_dest = db);
 #endif
         case OP_EQ_BCC: VEC_ARG2(b_dest = (c1r == c2r && c1i == c2i));
@@ -440,6 +459,19 @@
         case OP_COMPLEX_CDD: VEC_ARG2(cr_dest = d1;
                                       ci_dest = d2);
 
+        /* 3-vectors (the components are unrolled) */
+        case OP_COPY_VV: VEC_ARG1(memcpy(&vx_dest, s1, sizeof(double)*3));
+        case OP_DOT_DVV: VEC_ARG2(d_dest = v1x*v2x + v1y*v2y + v1z*v2z);
+        case OP_NORM_DV: VEC_ARG1(d_dest = sqrt(v1x*v1x + v1y*v1y +
+                                                v1z*v1z));
+        /* The destination may be one of the sources */
+        case OP_CROSS_VVV: VEC_ARG2(da = v1y*v2z - v1z*v2y;
+                                    db = v1z*v2x - v1x*v2z;
+                                    dc = v1x*v2y - v1y*v2x;
+                                    vx_dest = da;
+                                    vy_dest = db;
+                                    vz_dest = dc);
+
         /* Reductions */
         case OP_SUM_IIN: VEC_ARG1(i_reduce += i1);
         case OP_SUM_LLN: VEC_ARG1(l_reduce += l1);
@@ -452,7 +484,7 @@
         case OP_PROD_LLN: VEC_ARG1(l_reduce *= l1);
         case OP_PROD_FFN: VEC_ARG1(f_reduce *= f1);
         case OP_PROD_DDN: VEC_ARG1(d_reduce *= d1);
-        case OP_PROD_CCN: VEC_ARG1(da = cr_reduce*c1r - ci_reduce*c1i;
+        case OP_PROD_CCN: VEC_ARG1(da = cr_reduce*c1r + (-ci_reduce)*c1i;
                                    ci_reduce = cr_reduce*c1i + ci_reduce*c1r;
                                    cr_reduce = da);
 
@@ -461,6 +493,15 @@
             return -3;
             break;
         }
+
+        if (params.counters != NULL) {
+            pc_counters *counters = params.counters + pc/4;
+            npy_uint64 now = nx_ticks();
+            counters->calls++;
+            counters->elements += BLOCK_SIZE;
+            counters->ticks += now - tick;
+            tick = now;
+        }
     }
 
 #ifndef NO_OUTPUT_BUFFERING
@@ -489,6 +530,9 @@
 #undef cr_dest
 #undef ci_dest
 #undef s_dest
+#undef vx_dest
+#undef vy_dest
+#undef vz_dest
 #undef b1
 #undef i1
 #undef l1
@@ -497,6 +541,9 @@
 #undef c1r
 #undef c1i
 #undef s1
+#undef v1x
+#undef v1y
+#undef v1z
 #undef b2
 #undef i2
 #undef l2
@@ -505,6 +552,9 @@
 #undef c2r
 #undef c2i
 #undef s2
+#undef v2x
+#undef v2y
+#undef v2z
 #undef b3
 #undef i3
 #undef l3
@@ -513,6 +563,9 @@
 #undef c3r
 #undef c3i
 #undef s3
+#undef v3x
+#undef v3y
+#undef v3z
 }
 
 /*
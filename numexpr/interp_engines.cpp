@@ -0,0 +1,206 @@
+/*********************************************************************
+  Numexpr - Fast numerical array expression evaluator for NumPy.
+
+      License: MIT
+      Author:  See AUTHORS.txt
+
+  See LICENSE.txt for details about copyright and rights to use.
+**********************************************************************/
+
+/* The engines of the VM, included by interpreter.cpp once for every ISA
+   level (see isa.hpp), with NX_ISA_NAME() adding the suffix of the
+   level to the names and NX_ISA_TARGET the features to compile for. */
+
+/* Run the program on a tail of `size` elements (less than a block).
+
+   Loops of a size known to be a multiple of the vector width are
+   vectorized without a scalar epilogue (and at -O2, only those are
+   vectorized by recent compilers), so the tail runs in a multiple of
+   BLOCK_SIZE2 elements, and only its last few elements in a loop of a
+   variable size. */
+static NX_ISA_TARGET int
+NX_ISA_NAME(vm_engine_tail)(char **dataptr, npy_intp *strides, npy_intp size,
+                            npy_intp *memsteps, const vm_params& params,
+                            int *pc_error)
+{
+    char **mem = params.mem;
+    char **iter_dataptr = dataptr;
+    npy_intp *iter_strides = strides;
+    npy_intp nblocks = size / BLOCK_SIZE2, rest = size % BLOCK_SIZE2;
+    char *rest_dataptr[NPY_MAXARGS];
+    int i;
+
+    if (nblocks > 0) {
+#define REDUCTION_INNER_LOOP
+#define BLOCK_SIZE (nblocks * BLOCK_SIZE2)
+#include "interp_body.cpp"
+#undef BLOCK_SIZE
+#undef REDUCTION_INNER_LOOP
+    }
+    if (rest > 0) {
+        for (i = 0; i < 1 + params.n_inputs; i++) {
+            rest_dataptr[i] = dataptr[i] + nblocks * BLOCK_SIZE2 * strides[i];
+        }
+        iter_dataptr = rest_dataptr;
+#define REDUCTION_INNER_LOOP
+#define BLOCK_SIZE rest
+#include "interp_body.cpp"
+#undef BLOCK_SIZE
+#undef REDUCTION_INNER_LOOP
+    }
+    return 0;
+}
+
+/* Serial/parallel task iterator version of the VM engine */
+static NX_ISA_TARGET int
+NX_ISA_NAME(vm_engine_iter_task)(NpyIter *iter, npy_intp *memsteps,
+                                 const vm_params& params,
+                                 int *pc_error, char **errmsg)
+{
+    char **mem = params.mem;
+    NpyIter_IterNextFunc *iternext;
+    npy_intp block_size, *size_ptr;
+    char **iter_dataptr;
+    npy_intp *iter_strides;
+
+    iternext = NpyIter_GetIterNext(iter, errmsg);
+    if (iternext == NULL) {
+        return -1;
+    }
+
+    size_ptr = NpyIter_GetInnerLoopSizePtr(iter);
+    iter_dataptr = NpyIter_GetDataPtrArray(iter);
+    iter_strides = NpyIter_GetInnerStrideArray(iter);
+
+    /*
+     * First do all the blocks with a compile-time fixed size.
+     * This makes a big difference (30-50% on some tests).
+     */
+    block_size = *size_ptr;
+    while (block_size == BLOCK_SIZE1) {
+#define REDUCTION_INNER_LOOP
+#define BLOCK_SIZE BLOCK_SIZE1
+#include "interp_body.cpp"
+#undef BLOCK_SIZE
+#undef REDUCTION_INNER_LOOP
+        iternext(iter);
+        block_size = *size_ptr;
+    }
+
+    /* Then finish off the rest (smaller blocks, if any, and the tail) */
+    if (block_size > 0) do {
+        int r = NX_ISA_NAME(vm_engine_tail)(iter_dataptr, iter_strides,
+                                            *size_ptr, memsteps, params,
+                                            pc_error);
+        if (r < 0) {
+            return r;
+        }
+    } while (iternext(iter));
+
+    return 0;
+}
+
+static NX_ISA_TARGET int
+NX_ISA_NAME(vm_engine_iter_outer_reduce_task)(NpyIter *iter,
+                                              npy_intp *memsteps,
+                                              const vm_params& params,
+                                              int *pc_error, char **errmsg)
+{
+    char **mem = params.mem;
+    NpyIter_IterNextFunc *iternext;
+    npy_intp block_size, *size_ptr;
+    char **iter_dataptr;
+    npy_intp *iter_strides;
+
+    iternext = NpyIter_GetIterNext(iter, errmsg);
+    if (iternext == NULL) {
+        return -1;
+    }
+
+    size_ptr = NpyIter_GetInnerLoopSizePtr(iter);
+    iter_dataptr = NpyIter_GetDataPtrArray(iter);
+    iter_strides = NpyIter_GetInnerStrideArray(iter);
+
+    /*
+     * First do all the blocks with a compile-time fixed size.
+     * This makes a big difference (30-50% on some tests).
+     */
+    block_size = *size_ptr;
+    while (block_size == BLOCK_SIZE1) {
+#define BLOCK_SIZE BLOCK_SIZE1
+#define NO_OUTPUT_BUFFERING // Because it's a reduction
+#include "interp_body.cpp"
+#undef NO_OUTPUT_BUFFERING
+#undef BLOCK_SIZE
+        iternext(iter);
+        block_size = *size_ptr;
+    }
+
+    /* Then finish off the rest (smaller blocks, if any, and the tail) */
+    if (block_size > 0) do {
+        block_size = *size_ptr;
+#define BLOCK_SIZE block_size
+#define NO_OUTPUT_BUFFERING // Because it's a reduction
+#include "interp_body.cpp"
+#undef NO_OUTPUT_BUFFERING
+#undef BLOCK_SIZE
+    } while (iternext(iter));
+
+    return 0;
+}
+
+/* Compute the inner loops of `iter` up to its index `end`, in blocks of
+   `block_size`, without moving it past the last one */
+static NX_ISA_TARGET int
+NX_ISA_NAME(vm_engine_iter_stage)(NpyIter *iter, npy_intp end,
+                                  npy_intp block_size,
+                                  const vm_params& params, int *pc_error,
+                                  char **errmsg)
+{
+    char **mem = params.mem;
+    npy_intp *memsteps = params.memsteps;
+    NpyIter_IterNextFunc *iternext;
+    npy_intp size, offset, rest, *size_ptr;
+    char **inner_dataptr, *iter_dataptr[NPY_MAXARGS];
+    npy_intp *iter_strides;
+    int i, nops = 1 + params.n_inputs;
+
+    iternext = NpyIter_GetIterNext(iter, errmsg);
+    if (iternext == NULL) {
+        return -1;
+    }
+
+    size_ptr = NpyIter_GetInnerLoopSizePtr(iter);
+    inner_dataptr = NpyIter_GetDataPtrArray(iter);
+    iter_strides = NpyIter_GetInnerStrideArray(iter);
+
+    while (1) {
+        size = *size_ptr;
+        for (offset = 0; offset < size; offset += block_size) {
+            for (i = 0; i < nops; i++) {
+                iter_dataptr[i] = inner_dataptr[i] + offset * iter_strides[i];
+            }
+            rest = size - offset;
+            if (block_size == BLOCK_SIZE1 && rest >= BLOCK_SIZE1) {
+#define REDUCTION_INNER_LOOP
+#define BLOCK_SIZE BLOCK_SIZE1
+#include "interp_body.cpp"
+#undef BLOCK_SIZE
+#undef REDUCTION_INNER_LOOP
+            }
+            else {
+                int r = NX_ISA_NAME(vm_engine_tail)(iter_dataptr,
+                                iter_strides,
+                                rest < block_size ? rest : block_size,
+                                memsteps, params, pc_error);
+                if (r < 0) {
+                    return r;
+                }
+            }
+        }
+        if (NpyIter_GetIterIndex(iter) + size >= end) {
+            return 0;
+        }
+        iternext(iter);
+    }
+}
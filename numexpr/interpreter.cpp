@@ -18,6 +18,12 @@
 #include "complex_functions.hpp"
 #include "interpreter.hpp"
 #include "numexpr_object.hpp"
+#include "scheduler.hpp"
+#include "pipeline.hpp"
+#include "isa.hpp"
+#ifdef NX_MULTI_ISA
+#include <cpuid.h>
+#endif
 
 
 #ifndef SIZE_MAX
@@ -51,6 +57,11 @@ using namespace std;
 
 // Global state
 thread_data th_params;
+int numexpr_profiling = 0;
+int numexpr_timing = 0;
+thread_stats numexpr_thread_totals[MAX_THREADS];
+mem_usage numexpr_memory;
+npy_intp numexpr_memory_cap = 0;
 
 /* This file and interp_body should really be generated from a description of
    the opcodes -- there's too much repetition here for manually editing */
@@ -67,6 +78,7 @@ static char op_signature_table[][NUMEXPR_MAX_ARGS] = {
 #define Td 'd'
 #define Tc 'c'
 #define Ts 's'
+#define Tv 'v'
 #define Tn 'n'
 #define T0 0
 #define OPCODE(n, e, ex, rt, a1, a2, a3) {rt, a1, a2, a3},
@@ -79,6 +91,7 @@ static char op_signature_table[][NUMEXPR_MAX_ARGS] = {
 #undef Td
 #undef Tc
 #undef Ts
+#undef Tv
 #undef Tn
 #undef T0
 };
@@ -329,12 +342,32 @@ typecode_from_char(char c)
         case 'd': return NPY_DOUBLE;
         case 'c': return NPY_CDOUBLE;
         case 's': return NPY_STRING;
+        case 'v': return NPY_VOID;
         default:
-            PyErr_SetString(PyExc_TypeError, "signature value not in 'bilfdcs'");
+            PyErr_SetString(PyExc_TypeError, "signature value not in 'bilfdcsv'");
             return -1;
     }
 }
 
+/* The dtype for a signature char.  Vectors are opaque 3-vectors of
+   doubles for NumPy, so they need an explicit item size. */
+static PyArray_Descr *
+dtype_from_char(char c)
+{
+    if (c == 'v') {
+        PyArray_Descr *dtype = PyArray_DescrNewFromType(NPY_VOID);
+        if (dtype != NULL) {
+            dtype->elsize = 3*sizeof(double);
+        }
+        return dtype;
+    }
+    int typecode = typecode_from_char(c);
+    if (typecode == -1) {
+        return NULL;
+    }
+    return PyArray_DescrFromType(typecode);
+}
+
 static int
 last_opcode(PyObject *program_object) {
     Py_ssize_t n;
@@ -592,95 +625,203 @@ void free_temps_space(const vm_params& params, char **mem)
     }
 }
 
-/* Serial/parallel task iterator version of the VM engine */
-int vm_engine_iter_task(NpyIter *iter, npy_intp *memsteps,
-                    const vm_params& params,
-                    int *pc_error, char **errmsg)
-{
-    char **mem = params.mem;
-    NpyIter_IterNextFunc *iternext;
-    npy_intp block_size, *size_ptr;
-    char **iter_dataptr;
-    npy_intp *iter_strides;
+/* The engines of the VM, once for every ISA level */
+#define NX_ISA_CAT2(name, suffix) name##suffix
+#define NX_ISA_CAT(name, suffix) NX_ISA_CAT2(name, suffix)
+#define NX_ISA_NAME(name) NX_ISA_CAT(name, NX_ISA_SUFFIX)
+
+#define NX_ISA_SUFFIX _baseline
+#define NX_ISA_TARGET
+#include "interp_engines.cpp"
+#undef NX_ISA_TARGET
+#undef NX_ISA_SUFFIX
+
+#ifdef NX_MULTI_ISA
+#define NX_ISA_SUFFIX _v2
+#define NX_ISA_TARGET __attribute__((target(NX_ISA_V2_FEATURES)))
+#include "interp_engines.cpp"
+#undef NX_ISA_TARGET
+#undef NX_ISA_SUFFIX
+
+#define NX_ISA_SUFFIX _v3
+#define NX_ISA_TARGET __attribute__((target(NX_ISA_V3_FEATURES)))
+#include "interp_engines.cpp"
+#undef NX_ISA_TARGET
+#undef NX_ISA_SUFFIX
+
+#define NX_ISA_SUFFIX _v4
+#define NX_ISA_TARGET __attribute__((target(NX_ISA_V4_FEATURES)))
+/* AVX-512 has fused multiply-adds of its own, which must not be used
+   either (see isa.hpp) */
+#if defined(__clang__)
+#pragma clang fp contract(off)
+#else
+#pragma GCC push_options
+#pragma GCC optimize ("fp-contract=off")
+#endif
+#include "interp_engines.cpp"
+#if !defined(__clang__)
+#pragma GCC pop_options
+#endif
+#undef NX_ISA_TARGET
+#undef NX_ISA_SUFFIX
+#endif // NX_MULTI_ISA
+
+struct vm_engines {
+    int (*iter_task)(NpyIter *iter, npy_intp *memsteps,
+                     const vm_params& params, int *pc_error, char **errmsg);
+    int (*outer_reduce_task)(NpyIter *iter, npy_intp *memsteps,
+                             const vm_params& params, int *pc_error,
+                             char **errmsg);
+    int (*stage)(NpyIter *iter, npy_intp end, npy_intp block_size,
+                 const vm_params& params, int *pc_error, char **errmsg);
+};
 
-    iternext = NpyIter_GetIterNext(iter, errmsg);
-    if (iternext == NULL) {
-        return -1;
-    }
+#define NX_ENGINES(suffix) {vm_engine_iter_task##suffix,              \
+                            vm_engine_iter_outer_reduce_task##suffix, \
+                            vm_engine_iter_stage##suffix}
 
-    size_ptr = NpyIter_GetInnerLoopSizePtr(iter);
-    iter_dataptr = NpyIter_GetDataPtrArray(iter);
-    iter_strides = NpyIter_GetInnerStrideArray(iter);
+static const vm_engines engines[NX_ISA_N] = {
+    NX_ENGINES(_baseline),
+#ifdef NX_MULTI_ISA
+    NX_ENGINES(_v2),
+    NX_ENGINES(_v3),
+    NX_ENGINES(_v4),
+#endif
+};
 
-    /*
-     * First do all the blocks with a compile-time fixed size.
-     * This makes a big difference (30-50% on some tests).
-     */
-    block_size = *size_ptr;
-    while (block_size == BLOCK_SIZE1) {
-#define REDUCTION_INNER_LOOP
-#define BLOCK_SIZE BLOCK_SIZE1
-#include "interp_body.cpp"
-#undef BLOCK_SIZE
-#undef REDUCTION_INNER_LOOP
-        iternext(iter);
-        block_size = *size_ptr;
+const char *numexpr_isa_names[NX_ISA_N] = {
+    "baseline", "x86-64-v2", "x86-64-v3", "x86-64-v4"
+};
+int numexpr_isa = NX_ISA_BASELINE;
+static const vm_engines *vm = &engines[NX_ISA_BASELINE];
+
+#ifdef NX_MULTI_ISA
+/* Whether the CPU has the features of NX_ISA_V3_FEATURES that not every
+   compiler knows in __builtin_cpu_supports() (F16C, LZCNT and MOVBE) */
+static int
+cpu_has_v3_extras(void)
+{
+    unsigned int eax, ebx, ecx, edx;
+
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx) ||
+        !(ecx & bit_F16C) || !(ecx & bit_MOVBE)) {
+        return 0;
+    }
+    if (!__get_cpuid(0x80000001, &eax, &ebx, &ecx, &edx) ||
+        !(ecx & bit_LZCNT)) {
+        return 0;
     }
+    return 1;
+}
+#endif
 
-    /* Then finish off the rest */
-    if (block_size > 0) do {
-#define REDUCTION_INNER_LOOP
-#define BLOCK_SIZE block_size
-#include "interp_body.cpp"
-#undef BLOCK_SIZE
-#undef REDUCTION_INNER_LOOP
-    } while (iternext(iter));
+/* Every feature of the target string of a level is checked, as the
+   compiler may use any of them in its engines */
+int
+nx_isa_supported(int level)
+{
+#ifdef NX_MULTI_ISA
+    __builtin_cpu_init();
+    switch (level) {
+        case NX_ISA_V4:
+            if (!__builtin_cpu_supports("avx512f") ||
+                !__builtin_cpu_supports("avx512bw") ||
+                !__builtin_cpu_supports("avx512cd") ||
+                !__builtin_cpu_supports("avx512dq") ||
+                !__builtin_cpu_supports("avx512vl")) {
+                return 0;
+            }
+            // fallthrough
+        case NX_ISA_V3:
+            if (!__builtin_cpu_supports("avx") ||
+                !__builtin_cpu_supports("avx2") ||
+                !__builtin_cpu_supports("bmi") ||
+                !__builtin_cpu_supports("bmi2") ||
+                !cpu_has_v3_extras()) {
+                return 0;
+            }
+            // fallthrough
+        case NX_ISA_V2:
+            if (!__builtin_cpu_supports("sse3") ||
+                !__builtin_cpu_supports("ssse3") ||
+                !__builtin_cpu_supports("sse4.1") ||
+                !__builtin_cpu_supports("sse4.2") ||
+                !__builtin_cpu_supports("popcnt")) {
+                return 0;
+            }
+            return 1;
+    }
+#endif
+    return level == NX_ISA_BASELINE;
+}
 
+int
+nx_set_isa(int level)
+{
+    if (level < 0 || level >= NX_ISA_N || !nx_isa_supported(level)) {
+        return -1;
+    }
+    numexpr_isa = level;
+    vm = &engines[level];
     return 0;
 }
 
+/* Serial/parallel task iterator version of the VM engine */
+int vm_engine_iter_task(NpyIter *iter, npy_intp *memsteps,
+                    const vm_params& params,
+                    int *pc_error, char **errmsg)
+{
+    return vm->iter_task(iter, memsteps, params, pc_error, errmsg);
+}
+
+/* Serial version of the VM engine for iterators that need buffering.
+   The iterator and a copy of it take turns: while the buffers of one
+   are computed, the helper thread writes the outputs of the other back
+   and fills it with the next range (see pipeline.hpp). */
 static int
-vm_engine_iter_outer_reduce_task(NpyIter *iter, npy_intp *memsteps,
-                const vm_params& params, int *pc_error, char **errmsg)
+vm_engine_iter_pipelined(NpyIter *iter, NpyIter *copy, npy_intp block_size,
+                         const vm_params& params, int *pc_error,
+                         char **errmsg)
 {
-    char **mem = params.mem;
+    NpyIter *stage_iter[2] = {iter, copy};
+    NpyIter *current = iter;
     NpyIter_IterNextFunc *iternext;
-    npy_intp block_size, *size_ptr;
-    char **iter_dataptr;
-    npy_intp *iter_strides;
-
-    iternext = NpyIter_GetIterNext(iter, errmsg);
-    if (iternext == NULL) {
+    npy_intp start, vlen, istart, iend, next_end;
+    npy_intp stage = NpyIter_GetBufferSize(iter);
+    int k, r, r_copies;
+
+    NpyIter_GetIterIndexRange(iter, &start, &vlen);
+    iend = (start + stage < vlen) ? start + stage : vlen;
+    if (NpyIter_ResetToIterIndexRange(iter, start, iend, errmsg)
+            != NPY_SUCCEED) {
         return -1;
     }
 
-    size_ptr = NpyIter_GetInnerLoopSizePtr(iter);
-    iter_dataptr = NpyIter_GetDataPtrArray(iter);
-    iter_strides = NpyIter_GetInnerStrideArray(iter);
-
-    /*
-     * First do all the blocks with a compile-time fixed size.
-     * This makes a big difference (30-50% on some tests).
-     */
-    block_size = *size_ptr;
-    while (block_size == BLOCK_SIZE1) {
-#define BLOCK_SIZE BLOCK_SIZE1
-#define NO_OUTPUT_BUFFERING // Because it's a reduction
-#include "interp_body.cpp"
-#undef NO_OUTPUT_BUFFERING
-#undef BLOCK_SIZE
-        iternext(iter);
-        block_size = *size_ptr;
+    for (k = 0, istart = start; istart < vlen; k++, istart = iend) {
+        NpyIter *other = stage_iter[(k + 1) % 2];
+        current = stage_iter[k % 2];
+        iend = (istart + stage < vlen) ? istart + stage : vlen;
+        next_end = (iend + stage < vlen) ? iend + stage : vlen;
+        nx_pipeline_post(k > 0 ? other : NULL, iend < vlen ? other : NULL,
+                         iend, next_end);
+        r = vm->stage(current, iend, block_size, params, pc_error, errmsg);
+        /* The copies must be over before leaving, even on errors */
+        r_copies = nx_pipeline_wait(errmsg);
+        if (r < 0) {
+            return r;
+        }
+        if (r_copies < 0) {
+            return -1;
+        }
     }
 
-    /* Then finish off the rest */
-    if (block_size > 0) do {
-#define BLOCK_SIZE block_size
-#define NO_OUTPUT_BUFFERING // Because it's a reduction
-#include "interp_body.cpp"
-#undef NO_OUTPUT_BUFFERING
-#undef BLOCK_SIZE
-    } while (iternext(iter));
+    /* Write the outputs of the last range back */
+    iternext = NpyIter_GetIterNext(current, errmsg);
+    if (iternext == NULL) {
+        return -1;
+    }
+    iternext(current);
 
     return 0;
 }
@@ -688,15 +829,20 @@ vm_engine_iter_outer_reduce_task(NpyIter *iter, npy_intp *memsteps,
 /* Parallel iterator version of VM engine */
 static int
 vm_engine_iter_parallel(NpyIter *iter, const vm_params& params,
-                        bool need_output_buffering, int *pc_error,
-                        char **errmsg)
+                        bool need_output_buffering, int nthreads,
+                        npy_intp block_size, int *pc_error,
+                        char **errmsg, run_timing *timing)
 {
-    int i;
+    int i, sched_ret;
     npy_intp numblocks, taskfactor;
+    double t_copies = 0, t_compute = 0;
 
     if (errmsg == NULL) {
         return -1;
     }
+    if (timing != NULL) {
+        t_copies = nx_seconds();
+    }
 
     /* Populate parameters for worker threads */
     NpyIter_GetIterIndexRange(iter, &th_params.start, &th_params.vlen);
@@ -704,19 +850,23 @@ vm_engine_iter_parallel(NpyIter *iter, const vm_params& params,
      * Try to make it so each thread gets 16 tasks.  This is a compromise
      * between 1 task per thread and one block per task.
      */
-    taskfactor = 16*BLOCK_SIZE1*gs.nthreads;
+    taskfactor = 16*BLOCK_SIZE1*nthreads;
     numblocks = (th_params.vlen - th_params.start + taskfactor - 1) /
                             taskfactor;
     th_params.block_size = numblocks * BLOCK_SIZE1;
 
     th_params.params = params;
+    th_params.nthreads = nthreads;
+    th_params.buffer_size = block_size;
     th_params.need_output_buffering = need_output_buffering;
     th_params.ret_code = 0;
     th_params.pc_error = pc_error;
     th_params.errmsg = errmsg;
+    th_params.timing = (timing != NULL);
+    th_params.perf = (numexpr_perf != 0);
     th_params.iter[0] = iter;
     /* Make one copy for each additional thread */
-    for (i = 1; i < gs.nthreads; ++i) {
+    for (i = 1; i < nthreads; ++i) {
         th_params.iter[i] = NpyIter_Copy(iter);
         if (th_params.iter[i] == NULL) {
             --i;
@@ -728,7 +878,7 @@ vm_engine_iter_parallel(NpyIter *iter, const vm_params& params,
     }
     th_params.memsteps[0] = params.memsteps;
     /* Make one copy of memsteps for each additional thread */
-    for (i = 1; i < gs.nthreads; ++i) {
+    for (i = 1; i < nthreads; ++i) {
         th_params.memsteps[i] = PyMem_New(npy_intp,
                     1 + params.n_inputs + params.n_constants + params.n_temps);
         if (th_params.memsteps[i] == NULL) {
@@ -736,7 +886,7 @@ vm_engine_iter_parallel(NpyIter *iter, const vm_params& params,
             for (; i > 0; --i) {
                 PyMem_Del(th_params.memsteps[i]);
             }
-            for (i = 0; i < gs.nthreads; ++i) {
+            for (i = 1; i < nthreads; ++i) {
                 NpyIter_Deallocate(th_params.iter[i]);
             }
             return -1;
@@ -746,50 +896,188 @@ vm_engine_iter_parallel(NpyIter *iter, const vm_params& params,
                 (1 + params.n_inputs + params.n_constants + params.n_temps));
     }
 
-    Py_BEGIN_ALLOW_THREADS;
-
-    /* Synchronization point for all threads (wait for initialization) */
-    pthread_mutex_lock(&gs.count_threads_mutex);
-    if (gs.count_threads < gs.nthreads) {
-        gs.count_threads++;
-        pthread_cond_wait(&gs.count_threads_cv, &gs.count_threads_mutex);
+    if (timing != NULL) {
+        t_compute = nx_seconds();
+        timing->copies = t_compute - t_copies;
     }
-    else {
-        pthread_cond_broadcast(&gs.count_threads_cv);
-    }
-    pthread_mutex_unlock(&gs.count_threads_mutex);
 
-    /* Synchronization point for all threads (wait for finalization) */
-    pthread_mutex_lock(&gs.count_threads_mutex);
-    if (gs.count_threads > 0) {
-        gs.count_threads--;
-        pthread_cond_wait(&gs.count_threads_cv, &gs.count_threads_mutex);
-    }
-    else {
-        pthread_cond_broadcast(&gs.count_threads_cv);
+    /* Run the tasks in the threads of the current backend */
+    sched_ret = nx_run_parallel();
+
+    if (timing != NULL && sched_ret == 0) {
+        // The threads that finished earlier waited for the last one
+        double t_end = nx_seconds();
+        double busy = 0, max_busy = 0;
+        timing->compute = t_end - t_compute;
+        timing->barrier = 0;
+        for (i = 0; i < nthreads; ++i) {
+            thread_stats &stats = th_params.stats[i];
+            thread_stats &totals = numexpr_thread_totals[i];
+            stats.calls = 1;
+            stats.barrier = t_end - th_params.done_time[i];
+            stats.idle = th_params.done_time[i] - t_compute - stats.busy;
+            if (stats.idle < 0) {
+                stats.idle = 0;
+            }
+            totals.calls++;
+            totals.tasks += stats.tasks;
+            totals.elements += stats.elements;
+            totals.busy += stats.busy;
+            totals.idle += stats.idle;
+            totals.barrier += stats.barrier;
+            timing->barrier += stats.barrier;
+            busy += stats.busy;
+            if (stats.busy > max_busy) {
+                max_busy = stats.busy;
+            }
+        }
+        th_params.stats_nthreads = nthreads;
+        timing->barrier /= nthreads;
+        busy /= nthreads;
+        timing->imbalance = busy > 0 ? max_busy / busy : 1;
     }
-    pthread_mutex_unlock(&gs.count_threads_mutex);
 
-    Py_END_ALLOW_THREADS;
+    if (th_params.perf) {
+        th_params.perf_nthreads = nthreads;
+    }
 
     /* Deallocate all the iterator and memsteps copies */
-    for (i = 1; i < gs.nthreads; ++i) {
+    for (i = 1; i < nthreads; ++i) {
         NpyIter_Deallocate(th_params.iter[i]);
         PyMem_Del(th_params.memsteps[i]);
     }
 
-    return th_params.ret_code;
+    return sched_ret < 0 ? sched_ret : th_params.ret_code;
+}
+
+/* Add the counters of the threads to the ones of the expression */
+static void
+add_profile(NumExprObject *self, const pc_counters *counters,
+            int n_instructions, int nthreads)
+{
+    int i, t;
+
+    if (self->profile == NULL) {
+        self->profile = PyMem_New(pc_counters, n_instructions);
+        if (self->profile == NULL) {
+            return;
+        }
+        memset(self->profile, 0, n_instructions * sizeof(pc_counters));
+    }
+    for (t = 0; t < nthreads; t++) {
+        for (i = 0; i < n_instructions; i++) {
+            const pc_counters &c = counters[t * n_instructions + i];
+            self->profile[i].calls += c.calls;
+            self->profile[i].elements += c.elements;
+            self->profile[i].ticks += c.ticks;
+        }
+    }
+}
+
+/* The memory (by category) taken by a call with `nthreads` threads and
+   blocks of `block_size` elements.  The iterator buffers are an upper
+   bound, as only the operands that need them are buffered. */
+static void
+call_memory(const NumExprObject *self, bool need_output_buffering,
+            int nthreads, npy_intp block_size, npy_intp *bytes)
+{
+    int r, k = 1 + self->n_inputs + self->n_constants;
+
+    memset(bytes, 0, NX_MEM_N * sizeof(npy_intp));
+    for (r = k; r < k + self->n_temps; r++) {
+        bytes[NX_MEM_TEMPS] += self->memsizes[r];
+    }
+    for (r = 0; r <= self->n_inputs; r++) {
+        bytes[NX_MEM_BUFFERS] += self->memsizes[r];
+    }
+    if (need_output_buffering) {
+        bytes[NX_MEM_OUTPUT] = self->memsizes[0];
+    }
+    for (k = 0; k < NX_MEM_N; k++) {
+        bytes[k] *= nthreads * block_size;
+    }
+}
+
+/* The bytes left under the memory cap */
+static npy_intp
+memory_available(void)
+{
+    npy_intp available = numexpr_memory_cap;
+
+    for (int k = 0; k < NX_MEM_N; k++) {
+        available -= numexpr_memory.current[k];
+    }
+    return available;
+}
+
+/* Use less threads (and then smaller blocks) until a call fits in what
+   is left of the memory cap.  If it does not fit even with one thread
+   and the smallest blocks, it is run like that anyway. */
+static void
+fit_memory_cap(const NumExprObject *self, bool need_output_buffering,
+               int *nthreads, npy_intp *block_size)
+{
+    npy_intp bytes[NX_MEM_N], available, needed;
+    int k;
+
+    if (numexpr_memory_cap <= 0) {
+        return;
+    }
+    available = memory_available();
+    while (1) {
+        call_memory(self, need_output_buffering, 1, *block_size, bytes);
+        needed = 0;
+        for (k = 0; k < NX_MEM_N; k++) {
+            needed += bytes[k];
+        }
+        if (needed == 0 || *nthreads * needed <= available) {
+            return;
+        }
+        if (*nthreads > 1) {
+            *nthreads = available > needed ? (int)(available / needed) : 1;
+        }
+        else if (*block_size > MIN_BLOCK_SIZE) {
+            *block_size /= 2;
+        }
+        else {
+            return;
+        }
+    }
+}
+
+/* Whether a serial call still fits in what is left of the memory cap
+   with the larger buffers of the pipelined engine */
+static bool
+pipeline_fits_memory_cap(const NumExprObject *self,
+                         bool need_output_buffering, npy_intp block_size)
+{
+    npy_intp bytes[NX_MEM_N], needed = 0;
+
+    if (numexpr_memory_cap <= 0) {
+        return true;
+    }
+    call_memory(self, need_output_buffering, 1, block_size, bytes);
+    bytes[NX_MEM_BUFFERS] *= 2*PIPELINE_BLOCKS;
+    for (int k = 0; k < NX_MEM_N; k++) {
+        needed += bytes[k];
+    }
+    return needed <= memory_available();
 }
 
 static int
 run_interpreter(NumExprObject *self, NpyIter *iter, NpyIter *reduce_iter,
                      bool reduction_outer_loop, bool need_output_buffering,
+                     bool pipelined, int nthreads, npy_intp block_size,
                      int *pc_error)
 {
     int r;
     Py_ssize_t plen;
     vm_params params;
     char *errmsg = NULL;
+    run_timing *timing = numexpr_timing ? &self->timing : NULL;
+    double t_copies = 0, t_compute = 0;
+    bool perf = (numexpr_perf != 0);
+    perf_counts perf_start, perf_end, perf_delta;
 
     *pc_error = -1;
     if (PyBytes_AsStringAndSize(self->program, (char **)&(params.program),
@@ -810,23 +1098,59 @@ run_interpreter(NumExprObject *self, NpyIter *iter, NpyIter *reduce_iter,
     params.r_end = (int)PyBytes_Size(self->fullsig);
     params.out_buffer = NULL;
 
-    if ((gs.nthreads == 1) || gs.force_serial) {
+    // Every thread counts in its own array, and they are added up later
+    int n_instructions = params.prog_len / 4;
+    vector<pc_counters> counters(numexpr_profiling ?
+                                 n_instructions * nthreads : 0);
+    params.counters = numexpr_profiling ? &counters[0] : NULL;
+
+    if (timing != NULL) {
+        timing->size = NpyIter_GetIterSize(iter);
+        timing->nthreads = nthreads;
+        t_copies = nx_seconds();
+    }
+
+    if (perf) {
+        nx_perf_read(&perf_start);
+    }
+
+    if (nthreads == 1) {
         // Can do it as one "task"
         if (reduce_iter == NULL) {
             // Allocate memory for output buffering if needed
             vector<char> out_buffer(need_output_buffering ?
-                                (self->memsizes[0] * BLOCK_SIZE1) : 0);
+                                (self->memsizes[0] * block_size) : 0);
             params.out_buffer = need_output_buffering ? &out_buffer[0] : NULL;
             // Reset the iterator to allocate its buffers
             if(NpyIter_Reset(iter, NULL) != NPY_SUCCEED) {
                 return -1;
             }
-            get_temps_space(params, params.mem, BLOCK_SIZE1);
+            // The copy taking turns with it, if pipelined
+            NpyIter *copy = NULL;
+            if (pipelined) {
+                copy = NpyIter_Copy(iter);
+                if (copy == NULL) {
+                    return -1;
+                }
+            }
+            get_temps_space(params, params.mem, block_size);
+            if (timing != NULL) {
+                t_compute = nx_seconds();
+            }
             Py_BEGIN_ALLOW_THREADS;
-            r = vm_engine_iter_task(iter, params.memsteps,
+            if (copy != NULL) {
+                r = vm_engine_iter_pipelined(iter, copy, block_size,
+                                             params, pc_error, &errmsg);
+            }
+            else {
+                r = vm_engine_iter_task(iter, params.memsteps,
                                         params, pc_error, &errmsg);
+            }
             Py_END_ALLOW_THREADS;
             free_temps_space(params, params.mem);
+            if (copy != NULL) {
+                NpyIter_Deallocate(copy);
+            }
         }
         else {
             if (reduction_outer_loop) {
@@ -839,12 +1163,12 @@ run_interpreter(NumExprObject *self, NpyIter *iter, NpyIter *reduce_iter,
                     return -1;
                 }
 
-                get_temps_space(params, params.mem, BLOCK_SIZE1);
+                get_temps_space(params, params.mem, block_size);
                 Py_BEGIN_ALLOW_THREADS;
                 do {
                     r = NpyIter_ResetBasePointers(iter, dataptr, &errmsg);
                     if (r >= 0) {
-                        r = vm_engine_iter_outer_reduce_task(iter,
+                        r = vm->outer_reduce_task(iter,
                                                 params.memsteps, params,
                                                 pc_error, &errmsg);
                     }
@@ -865,7 +1189,7 @@ run_interpreter(NumExprObject *self, NpyIter *iter, NpyIter *reduce_iter,
                     return -1;
                 }
 
-                get_temps_space(params, params.mem, BLOCK_SIZE1);
+                get_temps_space(params, params.mem, block_size);
                 Py_BEGIN_ALLOW_THREADS;
                 do {
                     r = NpyIter_ResetBasePointers(reduce_iter, dataptr,
@@ -886,7 +1210,7 @@ run_interpreter(NumExprObject *self, NpyIter *iter, NpyIter *reduce_iter,
     else {
         if (reduce_iter == NULL) {
             r = vm_engine_iter_parallel(iter, params, need_output_buffering,
-                        pc_error, &errmsg);
+                        nthreads, block_size, pc_error, &errmsg, timing);
         }
         else {
             errmsg = "Parallel engine doesn't support reduction yet";
@@ -894,11 +1218,41 @@ run_interpreter(NumExprObject *self, NpyIter *iter, NpyIter *reduce_iter,
         }
     }
 
-    if (r < 0 && errmsg != NULL) {
+    if (r < 0 && errmsg != NULL && !PyErr_Occurred()) {
         PyErr_SetString(PyExc_RuntimeError, errmsg);
     }
 
-    return 0;
+    if (params.counters != NULL) {
+        add_profile(self, params.counters, n_instructions, nthreads);
+    }
+    if (perf && r >= 0) {
+        if (nthreads == 1) {
+            nx_perf_read(&perf_end);
+            nx_perf_delta(&perf_start, &perf_end, &perf_delta);
+            nx_perf_add(&self->perf, &perf_delta, self->perf_calls);
+        }
+        else {
+            // The main thread just waits for the workers
+            for (int i = 0; i < nthreads; i++) {
+                nx_perf_add(&self->perf, &th_params.thread_perf[i],
+                            self->perf_calls + i);
+            }
+        }
+        self->perf_calls++;
+        self->perf_elements += NpyIter_GetIterSize(iter);
+    }
+    if (timing != NULL && timing->nthreads == 1) {
+        // Nested iterations (reductions) are all counted as compute
+        double t_end = nx_seconds();
+        if (t_compute == 0) {
+            t_compute = t_copies;
+        }
+        timing->copies = t_compute - t_copies;
+        timing->compute = t_end - t_compute;
+        timing->imbalance = 1;
+    }
+
+    return (r < 0) ? r : 0;
 }
 
 static int
@@ -928,6 +1282,7 @@ run_interpreter_const(NumExprObject *self, char *output, int *pc_error)
     memsteps = self->memsteps;
     params.memsizes = self->memsizes;
     params.r_end = (int)PyBytes_Size(self->fullsig);
+    params.counters = NULL;
 
     mem = params.mem;
     get_temps_space(params, mem, 1);
@@ -958,6 +1313,7 @@ NumExpr_run(NumExprObject *self, PyObject *args, PyObject *kwds)
     npy_intp reduction_size = 1;
     int ex_uses_vml = 0, is_reduction = 0;
     bool reduction_outer_loop = false, need_output_buffering = false;
+    bool pipelined = false;
 
     // To specify axes when doing a reduction
     int op_axes_values[NPY_MAXARGS][NPY_MAXDIMS],
@@ -967,6 +1323,14 @@ NumExpr_run(NumExprObject *self, PyObject *args, PyObject *kwds)
     int **op_axes = NULL;
 
     NpyIter *iter = NULL, *reduce_iter = NULL;
+    double t_start = 0, t_ran = 0;
+    int nthreads;
+    npy_intp block_size = BLOCK_SIZE1, call_bytes[NX_MEM_N];
+
+    if (numexpr_timing) {
+        t_start = nx_seconds();
+        memset(&self->timing, 0, sizeof(self->timing));
+    }
 
     // Check whether we need to restart threads
     if (!gs.init_threads_done || gs.pid != getpid()) {
@@ -975,6 +1339,7 @@ NumExpr_run(NumExprObject *self, PyObject *args, PyObject *kwds)
 
     // Don't force serial mode by default
     gs.force_serial = 0;
+    nthreads = gs.nthreads;
 
     // Check whether there's a reduction as the final step
     is_reduction = last_opcode(self->program) > OP_REDUCTION;
@@ -1040,7 +1405,7 @@ NumExpr_run(NumExprObject *self, PyObject *args, PyObject *kwds)
             a = o;
         }
         operands[i+1] = (PyArrayObject *)a;
-        dtypes[i+1] = PyArray_DescrFromType(typecode);
+        dtypes[i+1] = dtype_from_char(c);
 
         if (operands[0] != NULL) {
             // Check for the case where "out" is one of the inputs
@@ -1126,8 +1491,8 @@ NumExpr_run(NumExprObject *self, PyObject *args, PyObject *kwds)
         if (oa_ndim == 0) {
             if (operands[0] == NULL) {
                 npy_intp dim = 1;
-                operands[0] = (PyArrayObject *)PyArray_SimpleNew(0, &dim,
-                                            typecode_from_char(retsig));
+                operands[0] = (PyArrayObject *)PyArray_SimpleNewFromDescr(
+                                            0, &dim, dtype_from_char(retsig));
                 if (!operands[0])
                     goto fail;
             } else if (PyArray_SIZE(operands[0]) != 1) {
@@ -1137,7 +1502,7 @@ NumExpr_run(NumExprObject *self, PyObject *args, PyObject *kwds)
             }
         }
 
-        dtypes[0] = PyArray_DescrFromType(typecode_from_char(retsig));
+        dtypes[0] = dtype_from_char(retsig);
 
         op_flags[0] = NPY_ITER_READWRITE|
                       NPY_ITER_ALLOCATE|
@@ -1152,7 +1517,7 @@ NumExpr_run(NumExprObject *self, PyObject *args, PyObject *kwds)
     else {
         char retsig = get_return_sig(self->program);
         if (retsig != 's') {
-            dtypes[0] = PyArray_DescrFromType(typecode_from_char(retsig));
+            dtypes[0] = dtype_from_char(retsig);
         } else {
             /* Since the *only* supported operation returning a string
              * is a copy, the size of returned strings
@@ -1197,8 +1562,8 @@ NumExpr_run(NumExprObject *self, PyObject *args, PyObject *kwds)
             // Allocate the output
             int ndim = PyArray_NDIM(operands[zeroi]);
             npy_intp *dims = PyArray_DIMS(operands[zeroi]);
-            operands[0] = (PyArrayObject *)PyArray_SimpleNew(ndim, dims,
-                                              typecode_from_char(retsig));
+            operands[0] = (PyArrayObject *)PyArray_SimpleNewFromDescr(
+                                        ndim, dims, dtype_from_char(retsig));
             if (operands[0] == NULL) {
                 goto fail;
             }
@@ -1217,8 +1582,8 @@ NumExpr_run(NumExprObject *self, PyObject *args, PyObject *kwds)
         /* Allocate the output */
         if (operands[0] == NULL) {
             npy_intp dim = 1;
-            operands[0] = (PyArrayObject *)PyArray_SimpleNew(0, &dim,
-                                        typecode_from_char(retsig));
+            operands[0] = (PyArrayObject *)PyArray_SimpleNewFromDescr(
+                                        0, &dim, dtype_from_char(retsig));
             if (operands[0] == NULL) {
                 goto fail;
             }
@@ -1253,6 +1618,9 @@ NumExpr_run(NumExprObject *self, PyObject *args, PyObject *kwds)
     }
 
 
+    /* Use less threads or smaller blocks if the memory is capped */
+    fit_memory_cap(self, need_output_buffering, &nthreads, &block_size);
+
     /* Allocate the iterator or nested iterators */
     if (reduction_size == 1) {
         /* When there's no reduction, reduction_size is 1 as well */
@@ -1265,7 +1633,7 @@ NumExpr_run(NumExprObject *self, PyObject *args, PyObject *kwds)
                             order, casting,
                             op_flags, dtypes,
                             -1, NULL, NULL,
-                            BLOCK_SIZE1);
+                            block_size);
         if (iter == NULL) {
             goto fail;
         }
@@ -1289,7 +1657,7 @@ NumExpr_run(NumExprObject *self, PyObject *args, PyObject *kwds)
                                 order, casting,
                                 op_flags, dtypes,
                                 oa_ndim, op_axes, NULL,
-                                BLOCK_SIZE1);
+                                block_size);
             if (iter == NULL) {
                 goto fail;
             }
@@ -1352,7 +1720,7 @@ NumExpr_run(NumExprObject *self, PyObject *args, PyObject *kwds)
                                 order, casting,
                                 op_flags, dtypes,
                                 1, op_axes, NULL,
-                                BLOCK_SIZE1);
+                                block_size);
             if (reduce_iter == NULL) {
                 goto fail;
             }
@@ -1390,9 +1758,59 @@ NumExpr_run(NumExprObject *self, PyObject *args, PyObject *kwds)
         gs.force_serial = 1;
     }
 
+    if (gs.force_serial) {
+        nthreads = 1;
+    }
+
+    /* Pipeline the buffering of serial calls, in larger buffers */
+    if (numexpr_pipelining && nthreads == 1 && !is_reduction &&
+            reduction_size == 1 && NpyIter_RequiresBuffering(iter) &&
+            NpyIter_GetIterSize(iter) >= 2*PIPELINE_BLOCKS*block_size &&
+            pipeline_fits_memory_cap(self, need_output_buffering,
+                                     block_size)) {
+        NpyIter_Deallocate(iter);
+        iter = NpyIter_AdvancedNew(n_inputs+1, operands,
+                            NPY_ITER_BUFFERED|
+                            NPY_ITER_REDUCE_OK|
+                            NPY_ITER_RANGED|
+                            NPY_ITER_DELAY_BUFALLOC|
+                            NPY_ITER_EXTERNAL_LOOP,
+                            order, casting,
+                            op_flags, dtypes,
+                            -1, NULL, NULL,
+                            PIPELINE_BLOCKS*block_size);
+        if (iter == NULL) {
+            goto fail;
+        }
+        pipelined = true;
+    }
+
+    if (numexpr_timing) {
+        self->timing.setup = nx_seconds() - t_start;
+    }
+
+    /* Account the memory of the call while it runs */
+    call_memory(self, need_output_buffering, nthreads, block_size,
+                call_bytes);
+    if (pipelined) {
+        call_bytes[NX_MEM_BUFFERS] *= 2*PIPELINE_BLOCKS;
+    }
+    nx_mem_add(&numexpr_memory, call_bytes);
+    nx_mem_add(&self->memory, call_bytes);
+
     r = run_interpreter(self, iter, reduce_iter,
                              reduction_outer_loop, need_output_buffering,
-                             &pc_error);
+                             pipelined, nthreads, block_size, &pc_error);
+
+    for (i = 0; i < NX_MEM_N; i++) {
+        call_bytes[i] = -call_bytes[i];
+    }
+    nx_mem_add(&numexpr_memory, call_bytes);
+    nx_mem_add(&self->memory, call_bytes);
+
+    if (numexpr_timing) {
+        t_ran = nx_seconds();
+    }
 
     if (r < 0) {
         if (r == -1) {
@@ -1427,6 +1845,16 @@ cleanup_and_exit:
         Py_XDECREF(dtypes[i]);
     }
 
+    if (numexpr_timing) {
+        if (t_ran != 0) {
+            self->timing.finalize = nx_seconds() - t_ran;
+        }
+        else {
+            // Empty or constant outcomes are all set up
+            self->timing.setup = nx_seconds() - t_start;
+        }
+    }
+
     return ret;
 fail:
     for (i = 0; i < n_inputs+1; i++) {
@@ -2,6 +2,8 @@
 #define NUMEXPR_INTERPRETER_HPP
 
 #include "numexpr_config.hpp"
+#include "profiler.hpp"
+#include "perfevents.hpp"
 
 // Forward declaration
 struct NumExprObject;
@@ -64,6 +66,9 @@ struct vm_params {
     // Memory for output buffering. If output buffering is unneeded,
     // it contains NULL.
     char *out_buffer;
+    // The counters of every instruction (one array per thread), or NULL
+    // when not profiling
+    pc_counters *counters;
 };
 
 // Structure for parameters in worker threads
@@ -74,6 +79,9 @@ struct thread_data {
     vm_params params;
     int ret_code;
     int *pc_error;
+    // Threads taking part in the call, and the size of their blocks
+    int nthreads;
+    npy_intp buffer_size;
     char **errmsg;
     // One memsteps array per thread
     npy_intp *memsteps[MAX_THREADS];
@@ -85,6 +93,23 @@ struct thread_data {
     bool reduction_outer_loop;
     // Flag indicating whether output buffering is needed
     bool need_output_buffering;
+    // Whether the threads time their work (see thread_stats)
+    bool timing;
+    // When timing, the time each thread finished its tasks
+    double done_time[MAX_THREADS];
+    // When timing, the work of each thread in the last parallel call
+    thread_stats stats[MAX_THREADS];
+    int stats_nthreads;
+    // Whether the threads read their hardware counters
+    bool perf;
+    // When reading them, the counts of each thread in the last parallel call
+    perf_counts thread_perf[MAX_THREADS];
+    int perf_nthreads;
+    // The thread indexes run so far in the current parallel call, the
+    // ones running, and whether more can still start (see scheduler.hpp)
+    bool task_ran[MAX_THREADS];
+    int tasks_running;
+    bool tasks_open;
 };
 
 // Global state which holds thread parameters
@@ -0,0 +1,55 @@
+#ifndef NUMEXPR_ISA_HPP
+#define NUMEXPR_ISA_HPP
+/*********************************************************************
+  Numexpr - Fast numerical array expression evaluator for NumPy.
+
+      License: MIT
+      Author:  See AUTHORS.txt
+
+  See LICENSE.txt for details about copyright and rights to use.
+**********************************************************************/
+
+/* The engines of the VM (the functions that include interp_body.cpp
+   for blocks of an iterator, see interp_engines.cpp) are compiled once
+   for every x86-64 ISA level, and the best level that the CPU supports
+   is selected when the module is imported.  With compilers or CPUs
+   where this is not possible, only the baseline is built. */
+
+#if (defined(__GNUC__) || defined(__clang__)) && \
+    (defined(__x86_64__) || defined(__i386__)) && !defined(_WIN32)
+#  define NX_MULTI_ISA 1
+#endif
+
+// The ISA levels
+enum {
+    NX_ISA_BASELINE,    // whatever the module is compiled for
+    NX_ISA_V2,          // x86-64-v2: SSE4.2, SSSE3 and POPCNT
+    NX_ISA_V3,          // x86-64-v3: AVX2, BMI1/2, F16C, LZCNT and MOVBE
+    NX_ISA_V4,          // x86-64-v4: AVX-512 F, BW, CD, DQ and VL
+    NX_ISA_N
+};
+
+/* The features every level is compiled with.  FMA is left out of v3,
+   as contracting a*b+c into a fused multiply-add would change the
+   results from one level to another.  AVX-512 has fused multiply-adds
+   of its own, so v4 is compiled without contractions, and the complex
+   products in interp_body.cpp are written so that they are not turned
+   into multiply-add/subtract instructions either.  nx_isa_supported()
+   must check every feature listed here. */
+#define NX_ISA_V2_FEATURES "sse3,ssse3,sse4.1,sse4.2,popcnt"
+#define NX_ISA_V3_FEATURES NX_ISA_V2_FEATURES \
+    ",avx,avx2,bmi,bmi2,f16c,lzcnt,movbe"
+#define NX_ISA_V4_FEATURES NX_ISA_V3_FEATURES \
+    ",avx512f,avx512bw,avx512cd,avx512dq,avx512vl"
+
+extern const char *numexpr_isa_names[NX_ISA_N];
+// The level of the engines in use
+extern int numexpr_isa;
+
+/* Whether a level was built and the CPU supports it */
+int nx_isa_supported(int level);
+
+/* Use the engines of a level.  Returns -1 if it is not supported. */
+int nx_set_isa(int level);
+
+#endif // NUMEXPR_ISA_HPP
@@ -12,9 +12,19 @@
 #include "module.hpp"
 #include <structmember.h>
 #include <vector>
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <unistd.h>
+#include <errno.h>
+#endif
 
 #include "interpreter.hpp"
 #include "numexpr_object.hpp"
+#include "codec.hpp"
+#include "perfevents.hpp"
+#include "scheduler.hpp"
+#include "pipeline.hpp"
+#include "isa.hpp"
 
 using namespace std;
 
@@ -23,34 +33,28 @@ using namespace std;
 global_state gs;
 
 
+/* Meeting point for all threads (wait for finalization) */
+static void
+wait_for_finalization(void)
+{
+    pthread_mutex_lock(&gs.count_threads_mutex);
+    if (gs.count_threads > 0) {
+        gs.count_threads--;
+        pthread_cond_wait(&gs.count_threads_cv, &gs.count_threads_mutex);
+    }
+    else {
+        pthread_cond_broadcast(&gs.count_threads_cv);
+    }
+    pthread_mutex_unlock(&gs.count_threads_mutex);
+}
+
 /* Do the worker job for a certain thread */
 void *th_worker(void *tidptr)
 {
     int tid = *(int *)tidptr;
-    /* Parameters for threads */
-    npy_intp start;
-    npy_intp vlen;
-    npy_intp block_size;
-    NpyIter *iter;
-    vm_params params;
-    int *pc_error;
-    int ret;
-    int n_inputs;
-    int n_constants;
-    int n_temps;
-    size_t memsize;
-    char **mem;
-    npy_intp *memsteps;
-    npy_intp istart, iend;
-    char **errmsg;
-    // For output buffering if needed
-    vector<char> out_buffer;
 
     while (1) {
 
-        /* Sentinels have to be initialised yet */
-        gs.init_sentinels_done = 0;
-
         /* Meeting point for all threads (wait for initialization) */
         pthread_mutex_lock(&gs.count_threads_mutex);
         if (gs.count_threads < gs.nthreads) {
@@ -64,115 +68,15 @@ void *th_worker(void *tidptr)
 
         /* Check if thread has been asked to return */
         if (gs.end_threads) {
+            nx_perf_close();
             return(0);
         }
 
-        /* Get parameters for this thread before entering the main loop */
-        start = th_params.start;
-        vlen = th_params.vlen;
-        block_size = th_params.block_size;
-        params = th_params.params;
-        pc_error = th_params.pc_error;
-
-        // If output buffering is needed, allocate it
-        if (th_params.need_output_buffering) {
-            out_buffer.resize(params.memsizes[0] * BLOCK_SIZE1);
-            params.out_buffer = &out_buffer[0];
-        } else {
-            params.out_buffer = NULL;
-        }
-
-        /* Populate private data for each thread */
-        n_inputs = params.n_inputs;
-        n_constants = params.n_constants;
-        n_temps = params.n_temps;
-        memsize = (1+n_inputs+n_constants+n_temps) * sizeof(char *);
-        /* XXX malloc seems thread safe for POSIX, but for Win? */
-        mem = (char **)malloc(memsize);
-        memcpy(mem, params.mem, memsize);
-
-        errmsg = th_params.errmsg;
-
-        params.mem = mem;
-
-        /* Loop over blocks */
-        pthread_mutex_lock(&gs.count_mutex);
-        if (!gs.init_sentinels_done) {
-            /* Set sentinels and other global variables */
-            gs.gindex = start;
-            istart = gs.gindex;
-            iend = istart + block_size;
-            if (iend > vlen) {
-                iend = vlen;
-            }
-            gs.init_sentinels_done = 1;  /* sentinels have been initialised */
-            gs.giveup = 0;            /* no giveup initially */
-        } else {
-            gs.gindex += block_size;
-            istart = gs.gindex;
-            iend = istart + block_size;
-            if (iend > vlen) {
-                iend = vlen;
-            }
-        }
-        /* Grab one of the iterators */
-        iter = th_params.iter[tid];
-        if (iter == NULL) {
-            th_params.ret_code = -1;
-            gs.giveup = 1;
-        }
-        memsteps = th_params.memsteps[tid];
-        /* Get temporary space for each thread */
-        ret = get_temps_space(params, mem, BLOCK_SIZE1);
-        if (ret < 0) {
-            /* Propagate error to main thread */
-            th_params.ret_code = ret;
-            gs.giveup = 1;
-        }
-        pthread_mutex_unlock(&gs.count_mutex);
-
-        while (istart < vlen && !gs.giveup) {
-            /* Reset the iterator to the range for this task */
-            ret = NpyIter_ResetToIterIndexRange(iter, istart, iend,
-                                                errmsg);
-            /* Execute the task */
-            if (ret >= 0) {
-                ret = vm_engine_iter_task(iter, memsteps, params, pc_error, errmsg);
-            }
-
-            if (ret < 0) {
-                pthread_mutex_lock(&gs.count_mutex);
-                gs.giveup = 1;
-                /* Propagate error to main thread */
-                th_params.ret_code = ret;
-                pthread_mutex_unlock(&gs.count_mutex);
-                break;
-            }
-
-            pthread_mutex_lock(&gs.count_mutex);
-            gs.gindex += block_size;
-            istart = gs.gindex;
-            iend = istart + block_size;
-            if (iend > vlen) {
-                iend = vlen;
-            }
-            pthread_mutex_unlock(&gs.count_mutex);
-        }
-
-        /* Meeting point for all threads (wait for finalization) */
-        pthread_mutex_lock(&gs.count_threads_mutex);
-        if (gs.count_threads > 0) {
-            gs.count_threads--;
-            pthread_cond_wait(&gs.count_threads_cv, &gs.count_threads_mutex);
-        }
-        else {
-            pthread_cond_broadcast(&gs.count_threads_cv);
-        }
-        pthread_mutex_unlock(&gs.count_threads_mutex);
+        /* Run the tasks of this thread (threads left out of this call,
+           see the memory cap, just wait) */
+        nx_run_task(NULL, tid);
 
-        /* Release resources */
-        free_temps_space(params, mem);
-        free(mem);
+        wait_for_finalization();
 
     }  /* closes while(1) */
 
@@ -191,6 +95,7 @@ int init_threads(void)
     /* Barrier initialization */
     pthread_mutex_init(&gs.count_threads_mutex, NULL);
     pthread_cond_init(&gs.count_threads_cv, NULL);
+    pthread_cond_init(&gs.tasks_done_cv, NULL);
     gs.count_threads = 0;      /* Reset threads counter */
 
     /* Finally, create the threads */
@@ -315,6 +220,616 @@ _set_num_threads(PyObject *self, PyObject *args)
     return Py_BuildValue("i", nthreads_old);
 }
 
+static PyObject *
+_set_profiling(PyObject *self, PyObject *args)
+{
+    int profiling, profiling_old;
+    if (!PyArg_ParseTuple(args, "i", &profiling))
+    return NULL;
+    profiling_old = numexpr_profiling;
+    numexpr_profiling = profiling;
+    return Py_BuildValue("i", profiling_old);
+}
+
+static PyObject *
+_set_timing(PyObject *self, PyObject *args)
+{
+    int timing, timing_old;
+    if (!PyArg_ParseTuple(args, "i", &timing))
+    return NULL;
+    timing_old = numexpr_timing;
+    numexpr_timing = timing;
+    return Py_BuildValue("i", timing_old);
+}
+
+static PyObject *
+_set_pipelining(PyObject *self, PyObject *args)
+{
+    int pipelining, pipelining_old;
+    if (!PyArg_ParseTuple(args, "i", &pipelining))
+    return NULL;
+    pipelining_old = numexpr_pipelining;
+    numexpr_pipelining = pipelining;
+    return Py_BuildValue("i", pipelining_old);
+}
+
+static PyObject *
+thread_stats_list(const thread_stats *stats, int nthreads)
+{
+    PyObject *list = PyList_New(nthreads);
+    if (list == NULL) {
+        return NULL;
+    }
+    for (int i = 0; i < nthreads; i++) {
+        const thread_stats &s = stats[i];
+        PyObject *item = Py_BuildValue("(KKKddd)", s.calls, s.tasks,
+                                       s.elements, s.busy, s.idle, s.barrier);
+        if (item == NULL) {
+            Py_DECREF(list);
+            return NULL;
+        }
+        PyList_SET_ITEM(list, i, item);
+    }
+    return list;
+}
+
+/* The work of the threads of the pool in the last timed parallel call
+   and added up since the last reset, as lists of (calls, tasks,
+   elements, busy, idle, barrier) tuples */
+static PyObject *
+_get_thread_stats(PyObject *self, PyObject *args)
+{
+    int reset = 0, nlast = th_params.stats_nthreads, ntotal = 0;
+    if (!PyArg_ParseTuple(args, "|i", &reset))
+        return NULL;
+    for (int i = 0; i < MAX_THREADS; i++) {
+        if (numexpr_thread_totals[i].calls > 0) {
+            ntotal = i + 1;
+        }
+    }
+    PyObject *last = thread_stats_list(th_params.stats, nlast);
+    PyObject *totals = thread_stats_list(numexpr_thread_totals, ntotal);
+    if (last == NULL || totals == NULL) {
+        Py_XDECREF(last);
+        Py_XDECREF(totals);
+        return NULL;
+    }
+    if (reset) {
+        th_params.stats_nthreads = 0;
+        memset(numexpr_thread_totals, 0, sizeof(numexpr_thread_totals));
+    }
+    return Py_BuildValue("(NN)", last, totals);
+}
+
+static PyObject *
+_set_memory_cap(PyObject *self, PyObject *args)
+{
+    Py_ssize_t cap, cap_old;
+    if (!PyArg_ParseTuple(args, "n", &cap))
+        return NULL;
+    cap_old = numexpr_memory_cap;
+    numexpr_memory_cap = cap;
+    return Py_BuildValue("n", cap_old);
+}
+
+/* The memory used by the VM in the whole process (see mem_usage_tuple) */
+static PyObject *
+_get_memory(PyObject *self, PyObject *args)
+{
+    int reset = 0;
+    if (!PyArg_ParseTuple(args, "|i", &reset))
+        return NULL;
+    PyObject *usage = mem_usage_tuple(&numexpr_memory);
+    if (usage != NULL && reset) {
+        mem_usage_reset(&numexpr_memory);
+    }
+    return usage;
+}
+
+static PyObject *
+_set_perf_counters(PyObject *self, PyObject *args)
+{
+    int perf, perf_old;
+    if (!PyArg_ParseTuple(args, "i", &perf))
+    return NULL;
+    perf_old = numexpr_perf;
+    numexpr_perf = perf;
+    return Py_BuildValue("i", perf_old);
+}
+
+/* The mask of the hardware counters that the calling thread can read */
+static PyObject *
+_perf_counters_valid(PyObject *self, PyObject *args)
+{
+    perf_counts counts;
+    return Py_BuildValue("i", nx_perf_read(&counts));
+}
+
+/* The hardware counters of every thread of the pool in the last
+   parallel call, as a list of (valid, cycles, instructions, cache
+   misses, branch misses) tuples */
+static PyObject *
+_get_thread_perf_counters(PyObject *self, PyObject *args)
+{
+    PyObject *list = PyList_New(th_params.perf_nthreads);
+    if (list == NULL) {
+        return NULL;
+    }
+    for (int i = 0; i < th_params.perf_nthreads; i++) {
+        const perf_counts &p = th_params.thread_perf[i];
+        PyObject *item = Py_BuildValue("(iKKKK)", p.valid,
+                                       p.value[NX_PERF_CYCLES],
+                                       p.value[NX_PERF_INSTRUCTIONS],
+                                       p.value[NX_PERF_CACHE_MISSES],
+                                       p.value[NX_PERF_BRANCH_MISSES]);
+        if (item == NULL) {
+            Py_DECREF(list);
+            return NULL;
+        }
+        PyList_SET_ITEM(list, i, item);
+    }
+    return list;
+}
+
+/* Select the backend of the parallel engine, by name.  For "callback",
+   `obj` is either a PyCapsule holding a nx_parallel_for_def (see
+   scheduler.hpp) or a Python callable, called as obj(task, n), that
+   must call task(i) for every i in range(n).  Returns the name of the
+   previous backend. */
+static PyObject *
+_set_scheduler(PyObject *self, PyObject *args)
+{
+    const char *name;
+    PyObject *obj = Py_None;
+    int kind;
+    scheduler_state sched = {0, NULL, NULL, NULL, NULL};
+    if (!PyArg_ParseTuple(args, "s|O", &name, &obj))
+        return NULL;
+    for (kind = 0; kind < NX_SCHED_N; kind++) {
+        if (strcmp(name, numexpr_scheduler_names[kind]) == 0) {
+            break;
+        }
+    }
+    if (kind == NX_SCHED_N || !nx_scheduler_available(kind)) {
+        return PyErr_Format(PyExc_ValueError,
+                            "scheduler '%s' is not available", name);
+    }
+    sched.kind = kind;
+    if (kind == NX_SCHED_CALLBACK) {
+        if (PyCapsule_IsValid(obj, NX_PARALLEL_FOR_CAPSULE)) {
+            nx_parallel_for_def *def = (nx_parallel_for_def *)
+                PyCapsule_GetPointer(obj, NX_PARALLEL_FOR_CAPSULE);
+            sched.parallel_for = def->parallel_for;
+            sched.user_data = def->user_data;
+        }
+        else if (PyCallable_Check(obj)) {
+            sched.callable = obj;
+        }
+        else {
+            return PyErr_Format(PyExc_TypeError,
+                                "the callback scheduler needs a callable or "
+                                "a '%s' capsule", NX_PARALLEL_FOR_CAPSULE);
+        }
+        Py_INCREF(obj);
+        sched.object = obj;
+    }
+    PyObject *previous = Py_BuildValue("s",
+        numexpr_scheduler_names[numexpr_scheduler.kind]);
+    Py_XDECREF(numexpr_scheduler.object);
+    numexpr_scheduler = sched;
+    return previous;
+}
+
+/* The names of the backends that were compiled in */
+static PyObject *
+_available_schedulers(PyObject *self, PyObject *args)
+{
+    PyObject *list = PyList_New(0);
+    if (list == NULL) {
+        return NULL;
+    }
+    for (int kind = 0; kind < NX_SCHED_N; kind++) {
+        if (!nx_scheduler_available(kind)) {
+            continue;
+        }
+        PyObject *name = Py_BuildValue("s", numexpr_scheduler_names[kind]);
+        if (name == NULL || PyList_Append(list, name) < 0) {
+            Py_XDECREF(name);
+            Py_DECREF(list);
+            return NULL;
+        }
+        Py_DECREF(name);
+    }
+    return list;
+}
+
+/* Keep VML single threaded inside the tasks of parallel calls (so that
+   its threads do not compete with the ones of numexpr) or not */
+static PyObject *
+_set_vml_auto_threads(PyObject *self, PyObject *args)
+{
+    int flag, previous = numexpr_vml_auto_threads;
+    if (!PyArg_ParseTuple(args, "i", &flag))
+        return NULL;
+    numexpr_vml_auto_threads = flag != 0;
+    return Py_BuildValue("i", previous);
+}
+
+/* Use the engines of an ISA level, by name (see isa.hpp).  Returns the
+   name of the previous level. */
+static PyObject *
+_set_isa(PyObject *self, PyObject *args)
+{
+    const char *name;
+    int level;
+    if (!PyArg_ParseTuple(args, "s", &name))
+        return NULL;
+    for (level = 0; level < NX_ISA_N; level++) {
+        if (strcmp(name, numexpr_isa_names[level]) == 0) {
+            break;
+        }
+    }
+    PyObject *previous = Py_BuildValue("s", numexpr_isa_names[numexpr_isa]);
+    if (previous == NULL) {
+        return NULL;
+    }
+    if (nx_set_isa(level) < 0) {
+        Py_DECREF(previous);
+        return PyErr_Format(PyExc_ValueError,
+                            "ISA level '%s' is not supported", name);
+    }
+    return previous;
+}
+
+/* The names of the ISA levels that were built and the CPU supports */
+static PyObject *
+_available_isas(PyObject *self, PyObject *args)
+{
+    PyObject *list = PyList_New(0);
+    if (list == NULL) {
+        return NULL;
+    }
+    for (int level = 0; level < NX_ISA_N; level++) {
+        if (!nx_isa_supported(level)) {
+            continue;
+        }
+        PyObject *name = Py_BuildValue("s", numexpr_isa_names[level]);
+        if (name == NULL || PyList_Append(list, name) < 0) {
+            Py_XDECREF(name);
+            Py_DECREF(list);
+            return NULL;
+        }
+        Py_DECREF(name);
+    }
+    return list;
+}
+
+/* Give the OS a hint about the use of the memory spanned by an array.
+
+   `advice` can be "willneed" (start reading the pages in ahead of
+   their use), "dontneed" (drop the pages from the process, only safe
+   for *shared* file mappings, as anonymous or private pages would be
+   lost) or "sync" (write dirty pages of a shared file mapping back to
+   disk).  This is a no-op on platforms without madvise(). */
+static PyObject *
+_madvise(PyObject *self, PyObject *args)
+{
+    PyArrayObject *array;
+    const char *advice;
+    if (!PyArg_ParseTuple(args, "O!s", &PyArray_Type, &array, &advice))
+        return NULL;
+#ifndef _WIN32
+    npy_intp lo = 0, hi = PyArray_ITEMSIZE(array);
+    int i, ret = 0;
+    if (PyArray_SIZE(array) == 0) {
+        Py_RETURN_NONE;
+    }
+    /* Byte extent of the array, taking into account negative strides */
+    for (i = 0; i < PyArray_NDIM(array); i++) {
+        npy_intp span = (PyArray_DIM(array, i) - 1) * PyArray_STRIDE(array, i);
+        if (span < 0) {
+            lo += span;
+        }
+        else {
+            hi += span;
+        }
+    }
+    size_t pagesize = (size_t)sysconf(_SC_PAGESIZE);
+    size_t start = (size_t)(PyArray_BYTES(array) + lo);
+    size_t stop = (size_t)(PyArray_BYTES(array) + hi);
+    if (strcmp(advice, "dontneed") == 0) {
+        /* Only whole pages, so that neighbouring data is not touched */
+        start = (start + pagesize - 1) & ~(pagesize - 1);
+        stop &= ~(pagesize - 1);
+    }
+    else {
+        start &= ~(pagesize - 1);
+        stop = (stop + pagesize - 1) & ~(pagesize - 1);
+    }
+    if (start >= stop) {
+        Py_RETURN_NONE;
+    }
+    Py_BEGIN_ALLOW_THREADS;
+    if (strcmp(advice, "willneed") == 0) {
+        ret = madvise((void *)start, stop - start, MADV_WILLNEED);
+    }
+    else if (strcmp(advice, "dontneed") == 0) {
+        ret = madvise((void *)start, stop - start, MADV_DONTNEED);
+    }
+    else if (strcmp(advice, "sync") == 0) {
+        ret = msync((void *)start, stop - start, MS_SYNC);
+    }
+    else {
+        ret = -2;
+    }
+    Py_END_ALLOW_THREADS;
+    if (ret == -2) {
+        return PyErr_Format(PyExc_ValueError, "unknown advice '%s'", advice);
+    }
+    /* Failing to follow the hints is not fatal, but failing to sync is */
+    if (ret < 0 && strcmp(advice, "sync") == 0) {
+        return PyErr_SetFromErrno(PyExc_OSError);
+    }
+#endif
+    Py_RETURN_NONE;
+}
+
+/* Read (write == 0) or write the whole data of a contiguous array from
+   (to) the file descriptor `fd`, starting at `offset`.  Short reads only
+   happen at the end of the file.  The GIL is released during the I/O,
+   so that it can be overlapped with computations in other threads. */
+static PyObject *
+positional_io(PyObject *args, int write)
+{
+    int fd;
+    PyArrayObject *array;
+    PY_LONG_LONG offset;
+    if (!PyArg_ParseTuple(args, "iO!L", &fd, &PyArray_Type, &array, &offset))
+        return NULL;
+    if (write ? !PyArray_ISCONTIGUOUS(array) : !PyArray_ISCARRAY(array)) {
+        PyErr_SetString(PyExc_ValueError, write ?
+                        "array must be C-contiguous" :
+                        "array must be C-contiguous and writeable");
+        return NULL;
+    }
+#ifndef _WIN32
+    char *buf = PyArray_BYTES(array);
+    size_t nbytes = (size_t)PyArray_NBYTES(array), done = 0;
+    ssize_t n = 0;
+    int err = 0;
+    Py_BEGIN_ALLOW_THREADS;
+    while (done < nbytes) {
+        if (write) {
+            n = pwrite(fd, buf + done, nbytes - done, (off_t)(offset + done));
+        }
+        else {
+            n = pread(fd, buf + done, nbytes - done, (off_t)(offset + done));
+        }
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            err = errno;
+            break;
+        }
+        done += n;
+    }
+    Py_END_ALLOW_THREADS;
+    if (n < 0) {
+        errno = err;
+        return PyErr_SetFromErrno(PyExc_OSError);
+    }
+    return PyLong_FromSize_t(done);
+#else
+    PyErr_SetString(PyExc_NotImplementedError,
+                    "positional I/O is not supported on this platform");
+    return NULL;
+#endif
+}
+
+static PyObject *
+_pread(PyObject *self, PyObject *args)
+{
+    return positional_io(args, 0);
+}
+
+static PyObject *
+_pwrite(PyObject *self, PyObject *args)
+{
+    return positional_io(args, 1);
+}
+
+/* Compress the data of a contiguous array into a bytes object.  The
+   bytes of the elements are shuffled before if `shuffle` is true. */
+static PyObject *
+_compress(PyObject *self, PyObject *args)
+{
+    PyArrayObject *array;
+    int shuffle = 1;
+    if (!PyArg_ParseTuple(args, "O!|i", &PyArray_Type, &array, &shuffle))
+        return NULL;
+    if (!PyArray_ISCONTIGUOUS(array)) {
+        PyErr_SetString(PyExc_ValueError, "array must be C-contiguous");
+        return NULL;
+    }
+    const char *data = PyArray_BYTES(array);
+    size_t nbytes = (size_t)PyArray_NBYTES(array);
+    size_t typesize = (size_t)PyArray_ITEMSIZE(array);
+    size_t bound = nx_compress_bound(nbytes);
+    if (bound > (size_t)(PY_SSIZE_T_MAX - NX_CODEC_HEADER)) {
+        PyErr_SetString(PyExc_ValueError, "array is too large");
+        return NULL;
+    }
+    PyObject *result = PyBytes_FromStringAndSize(NULL,
+                                                 NX_CODEC_HEADER + bound);
+    if (result == NULL) {
+        return NULL;
+    }
+    char *dest = PyBytes_AS_STRING(result);
+    char *tmp = NULL;
+    char flags = 0;
+    size_t csize = 0;
+    shuffle = shuffle && typesize > 1;
+    Py_BEGIN_ALLOW_THREADS;
+    const char *src = data;
+    if (shuffle && (tmp = (char *)malloc(nbytes ? nbytes : 1)) != NULL) {
+        nx_shuffle(typesize, nbytes / typesize, data, tmp);
+        src = tmp;
+        flags |= NX_CODEC_SHUFFLE;
+    }
+    if (!shuffle || tmp != NULL) {
+        csize = nx_lz4_compress(src, nbytes, dest + NX_CODEC_HEADER, bound);
+        if (csize == 0 || csize >= nbytes) {
+            // Not compressible, so keep the original data
+            memcpy(dest + NX_CODEC_HEADER, data, nbytes);
+            csize = nbytes;
+            flags = NX_CODEC_STORED;
+        }
+    }
+    free(tmp);
+    Py_END_ALLOW_THREADS;
+    if (shuffle && tmp == NULL) {
+        Py_DECREF(result);
+        return PyErr_NoMemory();
+    }
+    dest[0] = flags;
+    if (_PyBytes_Resize(&result, NX_CODEC_HEADER + csize) < 0) {
+        return NULL;
+    }
+    return result;
+}
+
+/* Decompress a bytes object made by _compress() into a contiguous array,
+   which must have the size and item size of the original one. */
+static PyObject *
+_decompress(PyObject *self, PyObject *args)
+{
+    PyObject *compressed;
+    PyArrayObject *array;
+    if (!PyArg_ParseTuple(args, "O!O!", &PyBytes_Type, &compressed,
+                          &PyArray_Type, &array))
+        return NULL;
+    if (!PyArray_ISCARRAY(array)) {
+        PyErr_SetString(PyExc_ValueError,
+                        "array must be C-contiguous and writeable");
+        return NULL;
+    }
+    const char *src = PyBytes_AS_STRING(compressed);
+    size_t csize = (size_t)PyBytes_GET_SIZE(compressed);
+    char *data = PyArray_BYTES(array);
+    size_t nbytes = (size_t)PyArray_NBYTES(array);
+    size_t typesize = (size_t)PyArray_ITEMSIZE(array);
+    if (csize < NX_CODEC_HEADER) {
+        PyErr_SetString(PyExc_ValueError, "corrupted compressed data");
+        return NULL;
+    }
+    char flags = src[0];
+    npy_intp dsize = -1;
+    char *tmp = NULL;
+    src += NX_CODEC_HEADER;
+    csize -= NX_CODEC_HEADER;
+    Py_BEGIN_ALLOW_THREADS;
+    if (flags & NX_CODEC_STORED) {
+        if (csize == nbytes) {
+            memcpy(data, src, nbytes);
+            dsize = nbytes;
+        }
+    }
+    else if (!(flags & NX_CODEC_SHUFFLE)) {
+        dsize = nx_lz4_decompress(src, csize, data, nbytes);
+    }
+    else if ((tmp = (char *)malloc(nbytes ? nbytes : 1)) != NULL) {
+        dsize = nx_lz4_decompress(src, csize, tmp, nbytes);
+        if (dsize == (npy_intp)nbytes) {
+            nx_unshuffle(typesize, nbytes / typesize, tmp, data);
+        }
+        free(tmp);
+    }
+    Py_END_ALLOW_THREADS;
+    if ((flags & NX_CODEC_SHUFFLE) && !(flags & NX_CODEC_STORED) &&
+            tmp == NULL) {
+        return PyErr_NoMemory();
+    }
+    if (dsize != (npy_intp)nbytes) {
+        PyErr_SetString(PyExc_ValueError,
+                        "corrupted compressed data or wrong array size");
+        return NULL;
+    }
+    Py_RETURN_NONE;
+}
+
+/* Copy some fields of the records [start, start + n) of a 1-d structured
+   array into contiguous arrays of n elements (one per field), reading
+   every record just once.  `offsets` has the offset of each field. */
+static PyObject *
+_deinterleave(PyObject *self, PyObject *args)
+{
+    PyArrayObject *rec;
+    PyObject *offsets, *outs;
+    Py_ssize_t start;
+    if (!PyArg_ParseTuple(args, "O!O!O!n", &PyArray_Type, &rec,
+                          &PyTuple_Type, &offsets, &PyTuple_Type, &outs,
+                          &start))
+        return NULL;
+    Py_ssize_t nfields = PyTuple_GET_SIZE(outs);
+    if (PyArray_NDIM(rec) != 1 || PyTuple_GET_SIZE(offsets) != nfields) {
+        PyErr_SetString(PyExc_ValueError,
+                        "expected a 1-d array and an offset per output");
+        return NULL;
+    }
+    vector<char *> dst(nfields);
+    vector<npy_intp> sizes(nfields), offs(nfields);
+    npy_intp n = 0, recsize = PyArray_ITEMSIZE(rec);
+    for (Py_ssize_t f = 0; f < nfields; f++) {
+        PyObject *out = PyTuple_GET_ITEM(outs, f);
+        if (!PyArray_Check(out) ||
+                !PyArray_ISCARRAY((PyArrayObject *)out) ||
+                PyArray_NDIM((PyArrayObject *)out) != 1) {
+            PyErr_SetString(PyExc_ValueError, "outputs must be 1-d, "
+                            "C-contiguous and writeable arrays");
+            return NULL;
+        }
+        PyArrayObject *a = (PyArrayObject *)out;
+        if (f == 0) {
+            n = PyArray_DIM(a, 0);
+        }
+        offs[f] = PyLong_AsSsize_t(PyTuple_GET_ITEM(offsets, f));
+        if (offs[f] == -1 && PyErr_Occurred()) {
+            return NULL;
+        }
+        dst[f] = PyArray_BYTES(a);
+        sizes[f] = PyArray_ITEMSIZE(a);
+        if (PyArray_DIM(a, 0) != n || offs[f] < 0 ||
+                offs[f] + sizes[f] > recsize) {
+            PyErr_SetString(PyExc_ValueError,
+                            "outputs do not match the records");
+            return NULL;
+        }
+    }
+    if (start < 0 || start + n > PyArray_DIM(rec, 0)) {
+        PyErr_SetString(PyExc_IndexError, "records out of range");
+        return NULL;
+    }
+    npy_intp stride = PyArray_STRIDE(rec, 0);
+    const char *src = PyArray_BYTES(rec) + start * stride;
+    Py_BEGIN_ALLOW_THREADS;
+    for (npy_intp i = 0; i < n; i++, src += stride) {
+        for (Py_ssize_t f = 0; f < nfields; f++) {
+            const char *field = src + offs[f];
+            switch (sizes[f]) {
+            case 1: dst[f][i] = *field; break;
+            case 2: memcpy(dst[f] + 2 * i, field, 2); break;
+            case 4: memcpy(dst[f] + 4 * i, field, 4); break;
+            case 8: memcpy(dst[f] + 8 * i, field, 8); break;
+            case 16: memcpy(dst[f] + 16 * i, field, 16); break;
+            default: memcpy(dst[f] + sizes[f] * i, field, sizes[f]);
+            }
+        }
+    }
+    Py_END_ALLOW_THREADS;
+    Py_RETURN_NONE;
+}
+
 static PyMethodDef module_methods[] = {
 #ifdef USE_VML
     {"_get_vml_version", _get_vml_version, METH_VARARGS,
@@ -326,6 +841,46 @@ static PyMethodDef module_methods[] = {
 #endif
     {"_set_num_threads", _set_num_threads, METH_VARARGS,
      "Suggests a maximum number of threads to be used in operations."},
+    {"_set_profiling", _set_profiling, METH_VARARGS,
+     "Enable or disable the instruction counters of the VM."},
+    {"_set_timing", _set_timing, METH_VARARGS,
+     "Enable or disable the timing of the phases of every call."},
+    {"_set_pipelining", _set_pipelining, METH_VARARGS,
+     "Enable or disable the pipelined buffering of serial calls."},
+    {"_set_memory_cap", _set_memory_cap, METH_VARARGS,
+     "Set the most memory that calls may use (0 for no limit)."},
+    {"_get_memory", _get_memory, METH_VARARGS,
+     "Get the (current, peak, peak total) memory used by the VM."},
+    {"_set_perf_counters", _set_perf_counters, METH_VARARGS,
+     "Enable or disable the hardware counters of every call."},
+    {"_perf_counters_valid", _perf_counters_valid, METH_NOARGS,
+     "Get the mask of the hardware counters that can be read."},
+    {"_get_thread_perf_counters", _get_thread_perf_counters, METH_NOARGS,
+     "Get the hardware counters of the threads in the last call."},
+    {"_set_scheduler", _set_scheduler, METH_VARARGS,
+     "Select the backend that runs the threads of parallel calls."},
+    {"_available_schedulers", _available_schedulers, METH_NOARGS,
+     "Get the names of the backends that were compiled in."},
+    {"_set_vml_auto_threads", _set_vml_auto_threads, METH_VARARGS,
+     "Keep VML single threaded inside parallel calls or not."},
+    {"_set_isa", _set_isa, METH_VARARGS,
+     "Use the engines of an ISA level and get the previous one."},
+    {"_available_isas", _available_isas, METH_NOARGS,
+     "Get the names of the ISA levels that the CPU supports."},
+    {"_get_thread_stats", _get_thread_stats, METH_VARARGS,
+     "Get the work of the threads in the last call and since the reset."},
+    {"_madvise", _madvise, METH_VARARGS,
+     "Give the OS a hint about the use of the memory of an array."},
+    {"_pread", _pread, METH_VARARGS,
+     "Read the data of an array from a file descriptor at an offset."},
+    {"_pwrite", _pwrite, METH_VARARGS,
+     "Write the data of an array to a file descriptor at an offset."},
+    {"_compress", _compress, METH_VARARGS,
+     "Compress the data of an array into a bytes object."},
+    {"_decompress", _decompress, METH_VARARGS,
+     "Decompress a bytes object into the data of an array."},
+    {"_deinterleave", _deinterleave, METH_VARARGS,
+     "Copy some fields of a block of records into contiguous arrays."},
     {NULL}
 };
 
@@ -400,6 +955,13 @@ initinterpreter()
 
     import_array();
 
+    /* Use the engines of the best ISA level that the CPU supports */
+    for (int level = NX_ISA_N - 1; level > NX_ISA_BASELINE; level--) {
+        if (nx_set_isa(level) == 0) {
+            break;
+        }
+    }
+
     d = PyDict_New();
     if (!d) INITERROR;
 
@@ -435,6 +997,8 @@ initinterpreter()
 
     if (PyModule_AddObject(m, "allaxes", PyLong_FromLong(255)) < 0) INITERROR;
     if (PyModule_AddObject(m, "maxdims", PyLong_FromLong(NPY_MAXDIMS)) < 0) INITERROR;
+    if (PyModule_AddStringConstant(m, "tick_unit", NX_TICK_UNIT) < 0) INITERROR;
+    if (PyModule_AddObject(m, "block_size", PyLong_FromLong(BLOCK_SIZE1)) < 0) INITERROR;
 
 #if PY_MAJOR_VERSION >= 3
     return m;
@@ -32,6 +32,7 @@ struct global_state {
     int count_threads;
     pthread_mutex_t count_threads_mutex;
     pthread_cond_t count_threads_cv;
+    pthread_cond_t tasks_done_cv;    /* the tasks of a call have finished */
 
     global_state() {
         nthreads = 1;
@@ -9,11 +9,14 @@
 ####################################################################
 
 import __future__
+import ast as python_ast
 import sys
 import numpy
 
 from numexpr import interpreter, expressions, use_vml, is_cpu_amd_intel
-from numexpr.utils import CacheDict
+from numexpr.utils import (
+    CacheDict, result_cache, timings, default_timer, perf_counter_names,
+    memory_dict)
 
 # Declare a double type that does not exist in Python space
 double = numpy.double
@@ -23,13 +26,19 @@ if sys.version_info[0] < 3:
 else:
     int_ = numpy.int32
     long_ = numpy.int64
+vector = expressions.vector
+
+# Vectors are seen by NumPy as opaque items of 3 doubles
+vector_dtype = numpy.dtype('V%d' % (3 * numpy.dtype(double).itemsize))
 
 typecode_to_kind = {'b': 'bool', 'i': 'int', 'l': 'long', 'f': 'float',
-                    'd': 'double', 'c': 'complex', 's': 'bytes', 'n': 'none'}
+                    'd': 'double', 'c': 'complex', 's': 'bytes', 'v': 'vector',
+                    'n': 'none'}
 kind_to_typecode = {'bool': 'b', 'int': 'i', 'long': 'l', 'float': 'f',
-                    'double': 'd', 'complex': 'c', 'bytes': 's', 'none': 'n'}
+                    'double': 'd', 'complex': 'c', 'bytes': 's', 'vector': 'v',
+                    'none': 'n'}
 type_to_typecode = {bool: 'b', int_: 'i', long_: 'l', float: 'f',
-                    double: 'd', complex: 'c', bytes: 's'}
+                    double: 'd', complex: 'c', bytes: 's', vector: 'v'}
 type_to_kind = expressions.type_to_kind
 kind_to_type = expressions.kind_to_type
 default_type = kind_to_type[expressions.default_kind]
@@ -224,6 +233,14 @@ class Immediate(Register):
         return 'Immediate(%d)' % (self.node.value,)
 
 
+def getCalledNames(s):
+    """Return the names called as functions in the string `s`."""
+    tree = python_ast.parse(s, '<expr>', 'eval')
+    return set(node.func.id for node in python_ast.walk(tree)
+               if isinstance(node, python_ast.Call) and
+               isinstance(node.func, python_ast.Name))
+
+
 def stringToExpression(s, types, context):
     """Given a string, convert it to a tree of ExpressionNode's.
     """
@@ -249,6 +266,13 @@ def stringToExpression(s, types, context):
                 t = types.get(name, default_type)
                 names[name] = expressions.VariableNode(name, type_to_kind[t])
         names.update(expressions.functions)
+        if any(name in c.co_names for name in expressions.vector_functions):
+            called = getCalledNames(s)
+            for name in expressions.vector_functions:
+                if name in c.co_names and name not in called:
+                    t = types.get(name, default_type)
+                    names[name] = expressions.VariableNode(
+                        name, type_to_kind[t])
         # now build the expression
         ex = eval(c, names)
         if expressions.isConstant(ex):
@@ -633,6 +657,90 @@ def disassemble(nex):
     return source
 
 
+def profile(ex, local_dict=None, global_dict=None, reset=False, **kwargs):
+    """Report the counters of the VM instructions of an expression.
+
+    `ex` can be a NumExpr object or an expression string, in which case
+    its operands are looked up like in `evaluate()` to find the compiled
+    form it is evaluated with.  The counters are only collected while
+    profiling is enabled (see `set_profiling()`), and are added up over
+    all the threads and evaluations since the previous reset.
+
+    Returns a list with a ``(instruction, calls, elements, ticks)``
+    tuple per instruction, where `instruction` is its disassembly (see
+    `disassemble()`), `calls` the number of blocks it has processed,
+    `elements` the number of elements and `ticks` the time spent on
+    them, in `interpreter.tick_unit` units (CPU cycles or nanoseconds).
+    If `reset` is true, the counters are reset after being read.
+    """
+    compiled_ex = _getCompiled(ex, local_dict, global_dict, kwargs,
+                               frame_depth=2)
+    counters = compiled_ex.get_profile()
+    if reset:
+        compiled_ex.reset_profile()
+    return [(instruction,) + c
+            for instruction, c in zip(disassemble(compiled_ex), counters)]
+
+
+def perf_counters(ex, local_dict=None, global_dict=None, reset=False,
+                  **kwargs):
+    """Report the hardware counters of the evaluations of an expression.
+
+    `ex` is looked up like in `profile()`.  The counters are only read
+    while they are enabled (see `set_perf_counters()`), and are added
+    up over all the threads and evaluations since the previous reset.
+
+    Returns a dictionary with the number of evaluations ('calls') and
+    elements ('elements') counted, the user space 'cycles',
+    'instructions', last level 'cache_misses' and 'branch_misses' (or
+    None for the counters that could not be read, see
+    `perf_counters_available()`) and the instructions per cycle
+    ('ipc').  If `reset` is true, the counters are reset after being
+    read.
+    """
+    compiled_ex = _getCompiled(ex, local_dict, global_dict, kwargs,
+                               frame_depth=2)
+    counters = compiled_ex.get_perf_counters()
+    if reset:
+        compiled_ex.reset_perf_counters()
+    calls, elements, valid = counters[:3]
+    result = {'calls': calls, 'elements': elements}
+    for i, name in enumerate(perf_counter_names):
+        result[name] = counters[3 + i] if valid & (1 << i) else None
+    cycles, instructions = result['cycles'], result['instructions']
+    result['ipc'] = (float(instructions) / cycles
+                     if cycles and instructions is not None else None)
+    return result
+
+
+def memory_usage(ex, local_dict=None, global_dict=None, reset=False,
+                 **kwargs):
+    """Report the memory used by the evaluations of an expression.
+
+    `ex` is looked up like in `profile()`.  Returns a dictionary like
+    `get_memory_usage()`, but for the calls of this expression only.
+    If `reset` is true, the peaks are reset after being read.
+    """
+    compiled_ex = _getCompiled(ex, local_dict, global_dict, kwargs,
+                               frame_depth=2)
+    return memory_dict(compiled_ex.get_memory(bool(reset)))
+
+
+def _getCompiled(ex, local_dict, global_dict, kwargs, frame_depth):
+    """The NumExpr object `ex` is evaluated with (or `ex` itself)."""
+    if isinstance(ex, interpreter.NumExpr):
+        return ex
+    context = getContext(kwargs, frame_depth=frame_depth)
+    expr_key, (names, _) = getCachedExprNames(ex, context)
+    arguments = [numpy.asarray(a) for a in
+                 getArguments(names, local_dict, global_dict,
+                              frame_depth=frame_depth)]
+    vector_names = getCachedVectorNames(ex, expr_key, context)
+    arguments = [asVectors(a) if name in vector_names else a
+                 for name, a in zip(names, arguments)]
+    return getCachedNumExpr(ex, expr_key, names, arguments, context)
+
+
 def getType(a):
     kind = a.dtype.kind
     if kind == 'b':
@@ -651,9 +759,47 @@ def getType(a):
         return complex
     if kind == 'S':
         return bytes
+    if a.dtype == vector_dtype:
+        return vector
     raise ValueError("unknown type %s" % a.dtype.name)
 
 
+class _ArrayInterface(object):
+    """Exposes a buffer of `base` with another dtype, shape and strides."""
+
+    def __init__(self, base, typestr, shape, strides):
+        self.base = base
+        self.__array_interface__ = {
+            'data': base.__array_interface__['data'], 'typestr': typestr,
+            'shape': shape, 'strides': strides, 'version': 3}
+
+
+def asVectors(a):
+    """View the trailing axis of length 3 of `a` as vectors."""
+    if a.dtype == vector_dtype:
+        return a
+    if a.ndim == 0 or a.shape[-1] != 3:
+        raise ValueError("vector operands need a trailing axis of length 3")
+    if a.dtype != double:
+        if not numpy.can_cast(a.dtype, double):
+            raise TypeError("vector operands must be real numbers")
+        a = a.astype(double)
+    if a.strides[-1] != a.itemsize or not a.flags.aligned:
+        a = numpy.ascontiguousarray(a)
+    return numpy.asarray(_ArrayInterface(a, vector_dtype.str, a.shape[:-1],
+                                         a.strides[:-1]))
+
+
+def fromVectors(a):
+    """View an array of vectors as doubles with a trailing axis of 3."""
+    if a.dtype != vector_dtype:
+        return a
+    itemsize = numpy.dtype(double).itemsize
+    return numpy.asarray(_ArrayInterface(a, numpy.dtype(double).str,
+                                         a.shape + (3,),
+                                         a.strides + (itemsize,)))
+
+
 def getExprNames(text, context):
     ex = stringToExpression(text, {}, context)
     ast = expressionToAST(ex)
@@ -680,13 +826,91 @@ def getExprNames(text, context):
     return [a.value for a in input_order], ex_uses_vml
 
 
+def getVectorNames(text, context):
+    """Return the names used as operands of the vector functions."""
+    ex = stringToExpression(text, {}, context)
+    ast = expressionToAST(ex)
+    vector_names = set()
+    for node in ast.postorderWalk():
+        if node.astType == 'op' and \
+                node.value in expressions.vector_functions:
+            vector_names.update(c.value for c in node.children
+                                if c.astType == 'variable')
+    return frozenset(vector_names)
+
+
 # Dictionaries for caching variable names and compiled expressions
 _names_cache = CacheDict(256)
 _numexpr_cache = CacheDict(256)
+_vector_names_cache = CacheDict(256)
+
+
+def getCachedExprNames(ex, context):
+    """Return the cache key and the (names, ex_uses_vml) pair for `ex`.
+    """
+    expr_key = (ex, tuple(sorted(context.items())))
+    if expr_key not in _names_cache:
+        _names_cache[expr_key] = getExprNames(ex, context)
+    return expr_key, _names_cache[expr_key]
+
+
+def getCachedVectorNames(ex, expr_key, context):
+    """Return the (cached) names used as vectors in `ex`.
+    """
+    try:
+        return _vector_names_cache[expr_key]
+    except KeyError:
+        pass
+    if 'dot' in ex or 'norm' in ex or 'cross' in ex:
+        vector_names = getVectorNames(ex, context)
+    else:
+        vector_names = frozenset()
+    _vector_names_cache[expr_key] = vector_names
+    return vector_names
+
+
+def getArguments(names, local_dict=None, global_dict=None, frame_depth=1):
+    """Get the arguments for `names`, looked up in the dictionaries.
+
+    When a dictionary is not given, the locals or globals of the frame
+    `frame_depth` levels above the caller are used instead.  The
+    objects are returned as found, without converting them to arrays.
+    """
+    call_frame = sys._getframe(frame_depth + 1)
+    if local_dict is None:
+        local_dict = call_frame.f_locals
+    if global_dict is None:
+        global_dict = call_frame.f_globals
+
+    arguments = []
+    for name in names:
+        try:
+            a = local_dict[name]
+        except KeyError:
+            a = global_dict[name]
+        arguments.append(a)
+    return arguments
+
+
+def getCachedNumExpr(ex, expr_key, names, arguments, context):
+    """Return the (cached) NumExpr object for `ex` and the `arguments` types.
+    """
+    # Create a signature
+    signature = [(name, getType(arg)) for (name, arg) in zip(names, arguments)]
+
+    # Look up numexpr if possible.
+    numexpr_key = expr_key + (tuple(signature),)
+    try:
+        compiled_ex = _numexpr_cache[numexpr_key]
+    except KeyError:
+        compiled_ex = _numexpr_cache[numexpr_key] = \
+            NumExpr(ex, signature, **context)
+    return compiled_ex
 
 
 def evaluate(ex, local_dict=None, global_dict=None,
-             out=None, order='K', casting='safe', **kwargs):
+             out=None, order='K', casting='safe', cache_version=None,
+             **kwargs):
     """Evaluate a simple array expression element-wise, using the new iterator.
 
     ex is a string forming an expression, like "2*a+3*b". The values for "a"
@@ -708,6 +932,8 @@ def evaluate(ex, local_dict=None, global_dict=None,
         required so that this array has the same shape and type than the
         actual outcome of the computation.  Useful for avoiding unnecessary
         new array allocations.
+        It can also be a `FileArray` opened for writing or a callable,
+        see `evaluate_chunked()`.
 
     order : {'C', 'F', 'A', or 'K'}, optional
         Controls the iteration order for operands. 'C' means C order, 'F'
@@ -728,40 +954,60 @@ def evaluate(ex, local_dict=None, global_dict=None,
           * 'same_kind' means only safe casts or casts within a kind,
             like float64 to float32, are allowed.
           * 'unsafe' means any data conversions may be done.
+
+    cache_version : hashable, optional
+        A token identifying the version of the operands, for the cache
+        of outcomes (see `set_result_cache_size()`).  Changing it makes
+        the outcome to be computed again.
     """
     if not isinstance(ex, (str, unicode)):
         raise ValueError("must specify expression as a string")
+    timed = timings.enabled
+    if timed:
+        start = default_timer()
     # Get the names for this expression
     context = getContext(kwargs, frame_depth=1)
-    expr_key = (ex, tuple(sorted(context.items())))
-    if expr_key not in _names_cache:
-        _names_cache[expr_key] = getExprNames(ex, context)
-    names, ex_uses_vml = _names_cache[expr_key]
+    expr_key, (names, ex_uses_vml) = getCachedExprNames(ex, context)
     # Get the arguments based on the names.
-    call_frame = sys._getframe(1)
-    if local_dict is None:
-        local_dict = call_frame.f_locals
-    if global_dict is None:
-        global_dict = call_frame.f_globals
-
-    arguments = []
-    for name in names:
-        try:
-            a = local_dict[name]
-        except KeyError:
-            a = global_dict[name]
-        arguments.append(numpy.asarray(a))
-
-    # Create a signature
-    signature = [(name, getType(arg)) for (name, arg) in zip(names, arguments)]
-
-    # Look up numexpr if possible.
-    numexpr_key = expr_key + (tuple(signature),)
-    try:
-        compiled_ex = _numexpr_cache[numexpr_key]
-    except KeyError:
-        compiled_ex = _numexpr_cache[numexpr_key] = \
-            NumExpr(ex, signature, **context)
+    arguments = getArguments(names, local_dict, global_dict, frame_depth=1)
+    if (hasattr(out, 'chunk_sink') or callable(out) or
+            any(hasattr(a, 'chunk_source') for a in arguments)):
+        # File-backed operands are streamed through the VM in chunks
+        from numexpr.chunked import evaluate_arguments
+        return evaluate_arguments(ex, names, arguments, context, expr_key,
+                                  ex_uses_vml, out, order=order,
+                                  casting=casting)
+    arguments = [numpy.asarray(a) for a in arguments]
+    vector_names = getCachedVectorNames(ex, expr_key, context)
+    if vector_names:
+        # The operands of the vector functions are seen as 3-vectors
+        arguments = [asVectors(a) if name in vector_names else a
+                     for name, a in zip(names, arguments)]
+
+    compiled_ex = getCachedNumExpr(ex, expr_key, names, arguments, context)
+    if timed:
+        parsed = default_timer()
     kwargs = {'out': out, 'order': order, 'casting': casting,
               'ex_uses_vml': ex_uses_vml}
-    return compiled_ex(*arguments, **kwargs)
+    if vector_names and out is not None and \
+            compiled_ex.fullsig[:1] == b'v':
+        kwargs['out'] = asVectors(numpy.asarray(out))
+    if result_cache.maxbytes and out is None:
+        key = result_cache.key(compiled_ex, arguments, order, casting,
+                               cache_version)
+        result = result_cache.get(key)
+        if result is None:
+            result = compiled_ex(*arguments, **kwargs)
+            result_cache.put(key, result, compiled_ex, arguments)
+        else:
+            timed = False   # the VM has not been run
+    else:
+        result = compiled_ex(*arguments, **kwargs)
+        if out is not None and result_cache.entries:
+            # The outcomes computed from `out` are stale now
+            result_cache.mark_modified([out])
+    if vector_names:
+        result = out if out is not None else fromVectors(result)
+    if timed:
+        timings.add(ex, start, parsed, compiled_ex)
+    return result
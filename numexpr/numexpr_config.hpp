@@ -24,6 +24,13 @@
 #define BLOCK_SIZE2 16
 #endif
 
+/* The smallest blocks used to fit a call in the memory cap */
+#define MIN_BLOCK_SIZE 64
+
+/* The blocks in every buffer of the iterator when its copies are
+   pipelined on a helper thread (see pipeline.hpp) */
+#define PIPELINE_BLOCKS 16
+
 /* The maximum number of threads (for some static arrays).
  * Choose this large enough for most monsters out there.
    Keep in sync this with the number in __init__.py. */
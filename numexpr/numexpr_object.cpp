@@ -25,12 +25,23 @@ size_from_char(char c)
         case 'd': return sizeof(double);
         case 'c': return 2*sizeof(double);
         case 's': return 0;  /* strings are ok but size must be computed */
+        case 'v': return 3*sizeof(double);
         default:
-            PyErr_SetString(PyExc_TypeError, "signature value not in 'bilfdcs'");
+            PyErr_SetString(PyExc_TypeError, "signature value not in 'bilfdcsv'");
             return -1;
     }
 }
 
+/* Account the blocks of constants of `self` as taking `rawmemsize` */
+static void
+account_constants(NumExprObject *self, int rawmemsize)
+{
+    npy_intp bytes[NX_MEM_N] = {0};
+    bytes[NX_MEM_CONSTANTS] = rawmemsize - self->rawmemsize;
+    nx_mem_add(&numexpr_memory, bytes);
+    nx_mem_add(&self->memory, bytes);
+}
+
 static void
 NumExpr_dealloc(NumExprObject *self)
 {
@@ -45,6 +56,8 @@ NumExpr_dealloc(NumExprObject *self)
     PyMem_Del(self->rawmem);
     PyMem_Del(self->memsteps);
     PyMem_Del(self->memsizes);
+    PyMem_Del(self->profile);
+    account_constants(self, 0);
     Py_TYPE(self)->tp_free((PyObject*)self);
 }
 
@@ -72,6 +85,12 @@ NumExpr_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
         self->rawmem = NULL;
         self->memsteps = NULL;
         self->memsizes = NULL;
+        self->profile = NULL;
+        memset(&self->timing, 0, sizeof(self->timing));
+        memset(&self->perf, 0, sizeof(self->perf));
+        self->perf_calls = 0;
+        self->perf_elements = 0;
+        memset(&self->memory, 0, sizeof(self->memory));
         self->rawmemsize = 0;
         self->n_inputs = 0;
         self->n_constants = 0;
@@ -339,6 +358,9 @@ NumExpr_init(NumExprObject *self, PyObject *args, PyObject *kwds)
     REPLACE_MEM(rawmem);
     REPLACE_MEM(memsteps);
     REPLACE_MEM(memsizes);
+    PyMem_Del(self->profile);
+    self->profile = NULL;
+    account_constants(self, rawmemsize);
     self->rawmemsize = rawmemsize;
     self->n_inputs = n_inputs;
     self->n_constants = n_constants;
@@ -351,8 +373,124 @@ NumExpr_init(NumExprObject *self, PyObject *args, PyObject *kwds)
     return check_program(self);
 }
 
+/* The (calls, elements, ticks) counters of every instruction */
+static PyObject *
+NumExpr_get_profile(NumExprObject *self)
+{
+    Py_ssize_t i, n = PyBytes_Size(self->program) / 4;
+    PyObject *profile = PyList_New(n);
+    if (profile == NULL) {
+        return NULL;
+    }
+    for (i = 0; i < n; i++) {
+        pc_counters c = {0, 0, 0};
+        if (self->profile != NULL) {
+            c = self->profile[i];
+        }
+        PyObject *item = Py_BuildValue("(KKK)", c.calls, c.elements, c.ticks);
+        if (item == NULL) {
+            Py_DECREF(profile);
+            return NULL;
+        }
+        PyList_SET_ITEM(profile, i, item);
+    }
+    return profile;
+}
+
+static PyObject *
+NumExpr_reset_profile(NumExprObject *self)
+{
+    PyMem_Del(self->profile);
+    self->profile = NULL;
+    Py_RETURN_NONE;
+}
+
+/* The time spent on every phase of the last call (when timing) */
+static PyObject *
+NumExpr_get_timing(NumExprObject *self)
+{
+    const run_timing &t = self->timing;
+    return Py_BuildValue("{sdsdsdsdsdsdsnsi}",
+                         "setup", t.setup, "copies", t.copies,
+                         "compute", t.compute, "barrier", t.barrier,
+                         "finalize", t.finalize, "imbalance", t.imbalance,
+                         "size", t.size, "nthreads", t.nthreads);
+}
+
+/* The hardware counters added up over the calls (when reading them) */
+static PyObject *
+NumExpr_get_perf_counters(NumExprObject *self)
+{
+    const perf_counts &p = self->perf;
+    return Py_BuildValue("(KKiKKKK)", self->perf_calls, self->perf_elements,
+                         p.valid, p.value[NX_PERF_CYCLES],
+                         p.value[NX_PERF_INSTRUCTIONS],
+                         p.value[NX_PERF_CACHE_MISSES],
+                         p.value[NX_PERF_BRANCH_MISSES]);
+}
+
+static PyObject *
+NumExpr_reset_perf_counters(NumExprObject *self)
+{
+    memset(&self->perf, 0, sizeof(self->perf));
+    self->perf_calls = 0;
+    self->perf_elements = 0;
+    Py_RETURN_NONE;
+}
+
+/* The bytes used by every category of memory: currently, at most and
+   at most in total (see mem_usage) */
+PyObject *
+mem_usage_tuple(const mem_usage *usage)
+{
+    const npy_intp *c = usage->current, *p = usage->peak;
+    return Py_BuildValue("((nnnn)(nnnn)n)",
+                         c[NX_MEM_TEMPS], c[NX_MEM_BUFFERS],
+                         c[NX_MEM_OUTPUT], c[NX_MEM_CONSTANTS],
+                         p[NX_MEM_TEMPS], p[NX_MEM_BUFFERS],
+                         p[NX_MEM_OUTPUT], p[NX_MEM_CONSTANTS],
+                         usage->peak_total);
+}
+
+/* Make the peaks of `usage` its current values */
+void
+mem_usage_reset(mem_usage *usage)
+{
+    usage->peak_total = 0;
+    for (int k = 0; k < NX_MEM_N; k++) {
+        usage->peak[k] = usage->current[k];
+        usage->peak_total += usage->current[k];
+    }
+}
+
+static PyObject *
+NumExpr_get_memory(NumExprObject *self, PyObject *args)
+{
+    int reset = 0;
+    if (!PyArg_ParseTuple(args, "|i", &reset))
+        return NULL;
+    PyObject *usage = mem_usage_tuple(&self->memory);
+    if (usage != NULL && reset) {
+        mem_usage_reset(&self->memory);
+    }
+    return usage;
+}
+
 static PyMethodDef NumExpr_methods[] = {
     {"run", (PyCFunction) NumExpr_run, METH_VARARGS|METH_KEYWORDS, NULL},
+    {"get_profile", (PyCFunction) NumExpr_get_profile, METH_NOARGS,
+     "Get the (calls, elements, ticks) counters of every instruction."},
+    {"reset_profile", (PyCFunction) NumExpr_reset_profile, METH_NOARGS,
+     "Reset the counters of the instructions."},
+    {"get_timing", (PyCFunction) NumExpr_get_timing, METH_NOARGS,
+     "Get the time spent on every phase of the last call."},
+    {"get_perf_counters", (PyCFunction) NumExpr_get_perf_counters,
+     METH_NOARGS, "Get the (calls, elements, valid, cycles, instructions, "
+     "cache misses, branch misses) hardware counters."},
+    {"reset_perf_counters", (PyCFunction) NumExpr_reset_perf_counters,
+     METH_NOARGS, "Reset the hardware counters."},
+    {"get_memory", (PyCFunction) NumExpr_get_memory, METH_VARARGS,
+     "Get the (current, peak, peak total) memory used by the calls."},
     {NULL, NULL}
 };
 
@@ -27,8 +27,17 @@ struct NumExprObject
     int  n_inputs;
     int  n_constants;
     int  n_temps;
+    pc_counters *profile;   /* accumulated instruction counters, or NULL */
+    run_timing timing;      /* phases of the last call (when timing) */
+    perf_counts perf;       /* accumulated hardware counters */
+    npy_uint64 perf_calls;  /* calls and elements they have counted */
+    npy_uint64 perf_elements;
+    mem_usage memory;       /* memory used by the calls */
 };
 
 extern PyTypeObject NumExprType;
 
+PyObject *mem_usage_tuple(const mem_usage *usage);
+void mem_usage_reset(mem_usage *usage);
+
 #endif // NUMEXPR_OBJECT_HPP
@@ -12,7 +12,7 @@ OPCODE(n, enum_name, exported, return_type, arg1_type, arg2_type, arg3_type)
 
 `exported` is NULL if the opcode shouldn't exported by the Python module.
 
-Types are Tb, Ti, Tl, Tf, Td, Tc, Ts, Tn, and T0; these symbols should be
+Types are Tb, Ti, Tl, Tf, Td, Tc, Ts, Tv, Tn, and T0; these symbols should be
 #defined to whatever is needed. (T0 is the no-such-arg type.)
 
 */
@@ -145,24 +145,29 @@ OPCODE(104, OP_WHERE_BBBB, "where_bbbb", Tb, Tb, Tb, Tb)
 
 OPCODE(105, OP_CONTAINS_BSS, "contains_bss", Tb, Ts, Ts, T0)
 
-OPCODE(106, OP_REDUCTION, NULL, T0, T0, T0, T0)
+OPCODE(106, OP_COPY_VV, "copy_vv", Tv, Tv, T0, T0)
+OPCODE(107, OP_DOT_DVV, "dot_dvv", Td, Tv, Tv, T0)
+OPCODE(108, OP_NORM_DV, "norm_dv", Td, Tv, T0, T0)
+OPCODE(109, OP_CROSS_VVV, "cross_vvv", Tv, Tv, Tv, T0)
+
+OPCODE(110, OP_REDUCTION, NULL, T0, T0, T0, T0)
 
 /* Last argument in a reduction is the axis of the array the
    reduction should be applied along. */
 
-OPCODE(107, OP_SUM, NULL, T0, T0, T0, T0)
-OPCODE(108, OP_SUM_IIN, "sum_iin", Ti, Ti, Tn, T0)
-OPCODE(109, OP_SUM_LLN, "sum_lln", Tl, Tl, Tn, T0)
-OPCODE(110, OP_SUM_FFN, "sum_ffn", Tf, Tf, Tn, T0)
-OPCODE(111, OP_SUM_DDN, "sum_ddn", Td, Td, Tn, T0)
-OPCODE(112, OP_SUM_CCN, "sum_ccn", Tc, Tc, Tn, T0)
+OPCODE(111, OP_SUM, NULL, T0, T0, T0, T0)
+OPCODE(112, OP_SUM_IIN, "sum_iin", Ti, Ti, Tn, T0)
+OPCODE(113, OP_SUM_LLN, "sum_lln", Tl, Tl, Tn, T0)
+OPCODE(114, OP_SUM_FFN, "sum_ffn", Tf, Tf, Tn, T0)
+OPCODE(115, OP_SUM_DDN, "sum_ddn", Td, Td, Tn, T0)
+OPCODE(116, OP_SUM_CCN, "sum_ccn", Tc, Tc, Tn, T0)
 
-OPCODE(113, OP_PROD, NULL, T0, T0, T0, T0)
-OPCODE(114, OP_PROD_IIN, "prod_iin", Ti, Ti, Tn, T0)
-OPCODE(115, OP_PROD_LLN, "prod_lln", Tl, Tl, Tn, T0)
-OPCODE(116, OP_PROD_FFN, "prod_ffn", Tf, Tf, Tn, T0)
-OPCODE(117, OP_PROD_DDN, "prod_ddn", Td, Td, Tn, T0)
-OPCODE(118, OP_PROD_CCN, "prod_ccn", Tc, Tc, Tn, T0)
+OPCODE(117, OP_PROD, NULL, T0, T0, T0, T0)
+OPCODE(118, OP_PROD_IIN, "prod_iin", Ti, Ti, Tn, T0)
+OPCODE(119, OP_PROD_LLN, "prod_lln", Tl, Tl, Tn, T0)
+OPCODE(120, OP_PROD_FFN, "prod_ffn", Tf, Tf, Tn, T0)
+OPCODE(121, OP_PROD_DDN, "prod_ddn", Td, Td, Tn, T0)
+OPCODE(122, OP_PROD_CCN, "prod_ccn", Tc, Tc, Tn, T0)
 
 /* Should be the last opcode */
-OPCODE(119, OP_END, NULL, T0, T0, T0, T0)
+OPCODE(123, OP_END, NULL, T0, T0, T0, T0)
@@ -0,0 +1,178 @@
+// Numexpr - Fast numerical array expression evaluator for NumPy.
+//
+//      License: MIT
+//      Author:  See AUTHORS.txt
+//
+//  See LICENSE.txt for details about copyright and rights to use.
+//
+// perfevents.cpp contains the hardware performance counters of the VM.
+
+#include "module.hpp"
+#include <string.h>
+
+#include "perfevents.hpp"
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+int numexpr_perf = 0;
+
+#ifdef __linux__
+
+static const npy_uint64 perf_configs[NX_PERF_N] = {
+    PERF_COUNT_HW_CPU_CYCLES,
+    PERF_COUNT_HW_INSTRUCTIONS,
+    PERF_COUNT_HW_CACHE_MISSES,
+    PERF_COUNT_HW_BRANCH_MISSES,
+};
+
+// The events opened by a thread, in the order they are read
+struct perf_group {
+    int opened;             // has the thread tried to open them?
+    int pid;                // the process that opened them
+    int fds[NX_PERF_N];
+    int order[NX_PERF_N];   // the counter of every value read
+    int n;                  // number of events opened
+    int valid;
+};
+
+static __thread perf_group group;
+
+static int
+open_event(npy_uint64 config, int group_fd)
+{
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = config;
+    attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED |
+                       PERF_FORMAT_TOTAL_TIME_RUNNING;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    // Count the calling thread on any CPU
+    int fd = (int)syscall(__NR_perf_event_open, &attr, 0, -1, group_fd, 0);
+    if (fd >= 0) {
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+    }
+    return fd;
+}
+
+static void
+open_group(void)
+{
+    int leader = -1;
+
+    group.opened = 1;
+    group.pid = (int)getpid();
+    group.n = 0;
+    group.valid = 0;
+    for (int k = 0; k < NX_PERF_N; k++) {
+        int fd = open_event(perf_configs[k], leader);
+        if (fd < 0) {
+            continue;
+        }
+        if (leader < 0) {
+            leader = fd;
+        }
+        group.fds[group.n] = fd;
+        group.order[group.n] = k;
+        group.n++;
+        group.valid |= 1 << k;
+    }
+}
+
+void
+nx_perf_close(void)
+{
+    for (int i = 0; i < group.n; i++) {
+        close(group.fds[i]);
+    }
+    group.opened = 0;
+    group.n = 0;
+    group.valid = 0;
+}
+
+int
+nx_perf_read(perf_counts *counts)
+{
+    // The number of events, the times enabled and running, the values
+    npy_uint64 buffer[3 + NX_PERF_N];
+
+    memset(counts, 0, sizeof(perf_counts));
+    if (group.opened && group.pid != (int)getpid()) {
+        // The events of a forked process still count its parent
+        nx_perf_close();
+    }
+    if (!group.opened) {
+        open_group();
+    }
+    if (group.n == 0) {
+        return 0;
+    }
+    ssize_t size = (3 + group.n) * sizeof(npy_uint64);
+    if (read(group.fds[0], buffer, size) != size ||
+            buffer[0] != (npy_uint64)group.n) {
+        return 0;
+    }
+    counts->enabled = buffer[1];
+    counts->running = buffer[2];
+    for (int i = 0; i < group.n; i++) {
+        counts->value[group.order[i]] = buffer[3 + i];
+    }
+    counts->valid = group.valid;
+    return counts->valid;
+}
+
+#else
+
+void
+nx_perf_close(void)
+{
+}
+
+int
+nx_perf_read(perf_counts *counts)
+{
+    memset(counts, 0, sizeof(perf_counts));
+    return 0;
+}
+
+#endif
+
+void
+nx_perf_delta(const perf_counts *start, const perf_counts *end,
+              perf_counts *delta)
+{
+    delta->valid = start->valid & end->valid;
+    delta->enabled = end->enabled - start->enabled;
+    delta->running = end->running - start->running;
+    if (delta->running == 0) {
+        // Never scheduled (or nothing to count)
+        delta->valid = 0;
+    }
+    for (int k = 0; k < NX_PERF_N; k++) {
+        delta->value[k] = end->value[k] - start->value[k];
+        if (delta->running > 0 && delta->running < delta->enabled) {
+            // Multiplexed: estimate the counts of the whole interval
+            delta->value[k] = (npy_uint64)((double)delta->value[k] *
+                                           delta->enabled / delta->running);
+        }
+    }
+}
+
+void
+nx_perf_add(perf_counts *total, const perf_counts *delta, npy_uint64 calls)
+{
+    total->valid = calls == 0 ? delta->valid : total->valid & delta->valid;
+    total->enabled += delta->enabled;
+    total->running += delta->running;
+    for (int k = 0; k < NX_PERF_N; k++) {
+        total->value[k] += delta->value[k];
+    }
+}
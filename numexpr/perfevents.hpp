@@ -0,0 +1,58 @@
+#ifndef NUMEXPR_PERFEVENTS_HPP
+#define NUMEXPR_PERFEVENTS_HPP
+/*********************************************************************
+  Numexpr - Fast numerical array expression evaluator for NumPy.
+
+      License: MIT
+      Author:  See AUTHORS.txt
+
+  See LICENSE.txt for details about copyright and rights to use.
+**********************************************************************/
+
+/* Hardware performance counters of the threads running the VM.
+
+   On Linux, every thread opens (on first use) a group of perf events
+   counting its own user space cycles, instructions, last level cache
+   misses and branch misses.  The events that cannot be opened (because
+   of perf_event_paranoid, seccomp filters, virtual machines without a
+   PMU or other platforms) are just reported as not valid.  When the
+   kernel multiplexes the group with other events, the counts are
+   scaled up to the time it was enabled. */
+
+// The counters of a group
+enum {
+    NX_PERF_CYCLES,
+    NX_PERF_INSTRUCTIONS,
+    NX_PERF_CACHE_MISSES,
+    NX_PERF_BRANCH_MISSES,
+    NX_PERF_N
+};
+
+struct perf_counts {
+    npy_uint64 value[NX_PERF_N];
+    npy_uint64 enabled; // time (ns) the group has been enabled...
+    npy_uint64 running; // ...and actually counting
+    int valid;          // bit mask of the counters that could be read
+};
+
+/* Read the counters of the calling thread into `counts`.  Returns the
+   mask of valid counters (0 if none could be opened). */
+int nx_perf_read(perf_counts *counts);
+
+/* Store in `delta` the counts between `start` and `end`, scaled if
+   the group was not counting all along (and not valid if it never
+   was) */
+void nx_perf_delta(const perf_counts *start, const perf_counts *end,
+                   perf_counts *delta);
+
+/* Add `delta` to `total`, which has added up `calls` deltas */
+void nx_perf_add(perf_counts *total, const perf_counts *delta,
+                 npy_uint64 calls);
+
+/* Close the counters of the calling thread */
+void nx_perf_close(void);
+
+// Whether the VM reads the counters around every call
+extern int numexpr_perf;
+
+#endif // NUMEXPR_PERFEVENTS_HPP
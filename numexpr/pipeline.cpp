@@ -0,0 +1,114 @@
+// Numexpr - Fast numerical array expression evaluator for NumPy.
+//
+//      License: MIT
+//      Author:  See AUTHORS.txt
+//
+//  See LICENSE.txt for details about copyright and rights to use.
+//
+// pipeline.cpp contains the helper thread filling the iterator buffers.
+
+#include "module.hpp"
+#include <string.h>
+
+#include "pipeline.hpp"
+
+int numexpr_pipelining = 0;
+
+static struct {
+    int pid;                    /* the process that started the thread */
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t cv;
+    bool posted;                /* some copies are waiting or running */
+    NpyIter *done, *next;
+    npy_intp start, end;
+    int ret;
+    char *errmsg;
+} helper;
+
+/* Do the copies posted to the helper */
+static int
+run_copies(void)
+{
+    helper.errmsg = NULL;
+    if (helper.done != NULL) {
+        NpyIter_IterNextFunc *iternext = NpyIter_GetIterNext(helper.done,
+                                                             &helper.errmsg);
+        if (iternext == NULL) {
+            return -1;
+        }
+        iternext(helper.done);
+    }
+    if (helper.next != NULL) {
+        if (NpyIter_ResetToIterIndexRange(helper.next, helper.start,
+                                          helper.end, &helper.errmsg)
+                != NPY_SUCCEED) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static void *
+helper_main(void *arg)
+{
+    pthread_mutex_lock(&helper.mutex);
+    while (1) {
+        while (!helper.posted) {
+            pthread_cond_wait(&helper.cv, &helper.mutex);
+        }
+        pthread_mutex_unlock(&helper.mutex);
+        int ret = run_copies();
+        pthread_mutex_lock(&helper.mutex);
+        helper.ret = ret;
+        helper.posted = false;
+        pthread_cond_broadcast(&helper.cv);
+    }
+    /* This should never be reached, but anyway */
+    return NULL;
+}
+
+void
+nx_pipeline_post(NpyIter *done, NpyIter *next, npy_intp start, npy_intp end)
+{
+    /* Start the helper the first time (also after a fork) */
+    if (helper.pid != (int)getpid()) {
+        pthread_mutex_init(&helper.mutex, NULL);
+        pthread_cond_init(&helper.cv, NULL);
+        helper.posted = false;
+        int rc = pthread_create(&helper.thread, NULL, helper_main, NULL);
+        if (rc) {
+            fprintf(stderr,
+                    "ERROR; return code from pthread_create() is %d\n", rc);
+            fprintf(stderr, "\tError detail: %s\n", strerror(rc));
+            exit(-1);
+        }
+        helper.pid = (int)getpid();
+    }
+
+    pthread_mutex_lock(&helper.mutex);
+    helper.done = done;
+    helper.next = next;
+    helper.start = start;
+    helper.end = end;
+    helper.posted = true;
+    pthread_cond_broadcast(&helper.cv);
+    pthread_mutex_unlock(&helper.mutex);
+}
+
+int
+nx_pipeline_wait(char **errmsg)
+{
+    int ret;
+
+    pthread_mutex_lock(&helper.mutex);
+    while (helper.posted) {
+        pthread_cond_wait(&helper.cv, &helper.mutex);
+    }
+    ret = helper.ret;
+    if (ret < 0 && *errmsg == NULL) {
+        *errmsg = helper.errmsg;
+    }
+    pthread_mutex_unlock(&helper.mutex);
+    return ret;
+}
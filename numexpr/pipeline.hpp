@@ -0,0 +1,34 @@
+#ifndef NUMEXPR_PIPELINE_HPP
+#define NUMEXPR_PIPELINE_HPP
+/*********************************************************************
+  Numexpr - Fast numerical array expression evaluator for NumPy.
+
+      License: MIT
+      Author:  See AUTHORS.txt
+
+  See LICENSE.txt for details about copyright and rights to use.
+**********************************************************************/
+
+/* A helper thread for the copies of a buffered iterator.
+
+   When the operands need buffering (casts, misaligned or non-contiguous
+   data), serial calls can use two copies of the iterator, and while the
+   VM computes the buffers of one of them, the helper copies the outputs
+   of the other back to the arrays and fills it with the next range. */
+
+// Whether serial calls that need buffering are pipelined
+extern int numexpr_pipelining;
+
+/* Start, on the helper thread, the copies of an iterator: moving `done`
+   (if not NULL) past its last inner loop, so that its outputs are
+   written back, then resetting `next` (if not NULL) to the range
+   [start, end), which fills its buffers.  Must be followed by
+   nx_pipeline_wait(). */
+void nx_pipeline_post(NpyIter *done, NpyIter *next,
+                      npy_intp start, npy_intp end);
+
+/* Wait for the copies started by nx_pipeline_post().  Returns -1 (and
+   sets `errmsg`, unless it is already set) if they failed. */
+int nx_pipeline_wait(char **errmsg);
+
+#endif // NUMEXPR_PIPELINE_HPP
@@ -0,0 +1,135 @@
+#ifndef NUMEXPR_PROFILER_HPP
+#define NUMEXPR_PROFILER_HPP
+/*********************************************************************
+  Numexpr - Fast numerical array expression evaluator for NumPy.
+
+      License: MIT
+      Author:  See AUTHORS.txt
+
+  See LICENSE.txt for details about copyright and rights to use.
+**********************************************************************/
+
+#ifdef _WIN32
+#  include <windows.h>
+#else
+#  include <time.h>
+#endif
+
+// Cheap timestamps for profiling the VM.  On x86 the time stamp counter
+// is used (in reference cycles); elsewhere, a monotonic clock (in ns).
+#if defined(__i386__) || defined(__x86_64__) || \
+    defined(_M_IX86) || defined(_M_X64)
+#  ifdef _MSC_VER
+#    include <intrin.h>
+#  else
+#    include <x86intrin.h>
+#  endif
+#  define NX_TICK_UNIT "cycles"
+
+static inline npy_uint64
+nx_ticks(void)
+{
+    return __rdtsc();
+}
+#else
+#  define NX_TICK_UNIT "ns"
+
+static inline npy_uint64
+nx_ticks(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (npy_uint64)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+#endif
+
+// Wall clock time in seconds, for timing the phases of a call
+static inline double
+nx_seconds(void)
+{
+#ifdef _WIN32
+    LARGE_INTEGER count, frequency;
+    QueryPerformanceCounter(&count);
+    QueryPerformanceFrequency(&frequency);
+    return (double)count.QuadPart / (double)frequency.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+#endif
+}
+
+// The counters of one instruction of a program
+struct pc_counters {
+    npy_uint64 calls;       // times it has been run (once per block)
+    npy_uint64 elements;    // elements processed
+    npy_uint64 ticks;       // time spent (see NX_TICK_UNIT)
+};
+
+// The time (in seconds) spent on every phase of a call
+struct run_timing {
+    double setup;       // checking the operands and building the iterator
+    double copies;      // iterator copies, buffers and temporaries
+    double compute;     // running the program (including barrier waits)
+    double barrier;     // mean wait of the threads for the slowest one
+    double finalize;    // releasing the iterators and getting the outcome
+    double imbalance;   // busy time of the busiest thread over the mean
+    npy_intp size;      // number of elements
+    int nthreads;       // threads used
+};
+
+// The work done by a thread of the pool (for a call, or added up)
+struct thread_stats {
+    npy_uint64 calls;   // parallel calls taken part in
+    npy_uint64 tasks;   // tasks (ranges of blocks) claimed
+    npy_uint64 elements;// elements processed
+    double busy;        // time running tasks
+    double idle;        // time waiting to start or to claim tasks
+    double barrier;     // time waiting for the other threads to finish
+};
+
+// The categories of the memory used by the VM
+enum {
+    NX_MEM_TEMPS,       // temporaries of every thread
+    NX_MEM_BUFFERS,     // buffers of the iterator and its per-thread copies
+    NX_MEM_OUTPUT,      // output buffers of every thread
+    NX_MEM_CONSTANTS,   // blocks of constants of the compiled expressions
+    NX_MEM_N
+};
+
+// The bytes currently used (and at most) by every category
+struct mem_usage {
+    npy_intp current[NX_MEM_N];
+    npy_intp peak[NX_MEM_N];
+    npy_intp peak_total;    // the peak of the sum of all the categories
+};
+
+// Add `bytes` (or remove them, if negative) to every category of `usage`
+static inline void
+nx_mem_add(mem_usage *usage, const npy_intp *bytes)
+{
+    npy_intp total = 0;
+    for (int k = 0; k < NX_MEM_N; k++) {
+        usage->current[k] += bytes[k];
+        if (usage->current[k] > usage->peak[k]) {
+            usage->peak[k] = usage->current[k];
+        }
+        total += usage->current[k];
+    }
+    if (total > usage->peak_total) {
+        usage->peak_total = total;
+    }
+}
+
+// Whether the VM collects the counters of the instructions
+extern int numexpr_profiling;
+// Whether the VM times the phases of every call
+extern int numexpr_timing;
+// The work of every thread of the pool, added up over the timed calls
+extern thread_stats numexpr_thread_totals[MAX_THREADS];
+// The memory used by the VM in the whole process
+extern mem_usage numexpr_memory;
+// The most memory that calls may use (0 for no limit)
+extern npy_intp numexpr_memory_cap;
+
+#endif // NUMEXPR_PROFILER_HPP
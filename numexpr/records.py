@@ -0,0 +1,138 @@
+###################################################################
+#  Numexpr - Fast numerical array expression evaluator for NumPy.
+#
+#      License: MIT
+#      Author:  See AUTHORS.txt
+#
+#  See LICENSE.txt and LICENSES/*.txt for details about copyright and
+#  rights to use.
+####################################################################
+
+"""
+Evaluation of expressions over the fields of structured (record) arrays.
+
+The fields of a structured array are strided views, and evaluating an
+expression on several of them reads the same records once per field.
+Here, blocks of records are read just once, copying all the fields
+used in the expression into contiguous buffers in a single pass.
+"""
+
+import numpy
+
+from numexpr import interpreter
+from numexpr.necompiler import getContext, getCachedExprNames, getArguments
+from numexpr.chunked import evaluate_arguments
+
+# The default size (in bytes) of the field buffers for a block of records
+BLOCK_BYTES = 256 * 2 ** 10
+
+
+class _RecordBlock(object):
+    """The buffers with the fields of the block of records last read."""
+
+    def __init__(self, rec, names):
+        self.rec = rec
+        self.names = names
+        fields = rec.dtype.fields
+        self.offsets = tuple(fields[name][1] for name in names)
+        self.dtypes = [fields[name][0] for name in names]
+        self.buffers = None
+        self.loaded = None
+
+    def load(self, start, stop):
+        if self.loaded == (start, stop):
+            return
+        nrows = stop - start
+        if self.buffers is None or len(self.buffers[0]) < nrows:
+            self.buffers = [numpy.empty(nrows, dtype=dtype)
+                            for dtype in self.dtypes]
+        outs = tuple(b[:nrows] for b in self.buffers)
+        interpreter._deinterleave(self.rec, self.offsets, outs, start)
+        self.loaded = (start, stop)
+
+    def field(self, i, start, stop):
+        self.load(start, stop)
+        return self.buffers[i][:stop - start]
+
+
+class RecordField(object):
+    """A field of a structured array, read through a `_RecordBlock`."""
+
+    def __init__(self, block, i):
+        self.block = block
+        self.i = i
+        self.dtype = block.dtypes[i]
+        self.shape = block.rec.shape
+
+    def chunk_source(self, nrows, ndim):
+        return _FieldSource(self, nrows, ndim)
+
+
+class _FieldSource(object):
+    def __init__(self, field, nrows, ndim):
+        self.field = field
+        self.dtype = field.dtype
+        self.split = (ndim == 1 and field.shape[0] == nrows and nrows != 1)
+
+    def chunk(self, start, stop):
+        if not self.split:
+            start, stop = 0, self.field.shape[0]
+        return self.field.block.field(self.field.i, start, stop)
+
+    def prefetch(self, start, stop):
+        pass
+
+    def release(self, start, stop):
+        pass
+
+    def close(self):
+        pass
+
+
+def _is_simple(dtype):
+    """Whether the fields of `dtype` can be copied as plain bytes."""
+    return dtype.shape == () and dtype.names is None and not dtype.hasobject
+
+
+def evaluate_records(ex, rec, local_dict=None, global_dict=None, out=None,
+                     chunklen=None, order='K', casting='safe', **kwargs):
+    """Evaluate an expression over the fields of a structured array.
+
+    The names in `ex` that are fields of the 1-d structured array `rec`
+    refer to them, and the rest are looked up like in `evaluate()`.
+    Instead of iterating over every field separately, blocks of
+    `chunklen` records are read once, copying the fields used in the
+    expression into contiguous buffers.  By default, blocks with fields
+    taking about `BLOCK_BYTES` are used.
+
+    See `evaluate_chunked()` for the rest of parameters.
+    """
+    if not isinstance(ex, (str, unicode)):
+        raise ValueError("must specify expression as a string")
+    rec = numpy.asarray(rec)
+    if rec.dtype.names is None or rec.ndim != 1:
+        raise ValueError("rec must be a 1-d structured array")
+    context = getContext(kwargs, frame_depth=1)
+    expr_key, (names, ex_uses_vml) = getCachedExprNames(ex, context)
+
+    fields = rec.dtype.fields
+    copied = [name for name in names
+              if name in fields and _is_simple(fields[name][0])]
+    others = [name for name in names if name not in fields]
+    values = dict(zip(others, getArguments(others, local_dict, global_dict,
+                                           frame_depth=1)))
+    block = _RecordBlock(rec, copied)
+    for i, name in enumerate(copied):
+        values[name] = RecordField(block, i)
+    for name in names:
+        if name in fields and name not in copied:
+            # Subarray fields are not copied, but used as strided views
+            values[name] = rec[name]
+    arguments = [values[name] for name in names]
+
+    if chunklen is None:
+        rowbytes = sum(dtype.itemsize for dtype in block.dtypes)
+        chunklen = max(1024, BLOCK_BYTES // max(rowbytes, 1))
+    return evaluate_arguments(ex, names, arguments, context, expr_key,
+                              ex_uses_vml, out, chunklen, order=order,
+                              casting=casting)
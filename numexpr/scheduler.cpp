@@ -0,0 +1,340 @@
+// Numexpr - Fast numerical array expression evaluator for NumPy.
+//
+//      License: MIT
+//      Author:  See AUTHORS.txt
+//
+//  See LICENSE.txt for details about copyright and rights to use.
+//
+// scheduler.cpp contains the backends running the parallel engine.
+
+#include "module.hpp"
+#include <string.h>
+#include <vector>
+
+#include "interpreter.hpp"
+#include "scheduler.hpp"
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+using namespace std;
+
+scheduler_state numexpr_scheduler = {NX_SCHED_POOL, NULL, NULL, NULL, NULL};
+const char *numexpr_scheduler_names[NX_SCHED_N] = {
+    "pool", "openmp", "callback"
+};
+int numexpr_vml_auto_threads = 1;
+
+int
+nx_scheduler_available(int kind)
+{
+    switch (kind) {
+        case NX_SCHED_POOL:
+        case NX_SCHED_CALLBACK:
+            return 1;
+#ifdef _OPENMP
+        case NX_SCHED_OPENMP:
+            return 1;
+#endif
+    }
+    return 0;
+}
+
+/* Run the tasks of the call set up in th_params as thread `tid` */
+static void
+thread_tasks(int tid)
+{
+    /* Parameters for threads */
+    npy_intp start;
+    npy_intp vlen;
+    npy_intp block_size;
+    NpyIter *iter;
+    vm_params params;
+    int *pc_error;
+    int ret;
+    int n_inputs;
+    int n_constants;
+    int n_temps;
+    size_t memsize;
+    char **mem;
+    npy_intp *memsteps;
+    npy_intp istart, iend;
+    char **errmsg;
+    thread_stats *stats;
+    double t_task = 0;
+    perf_counts perf_start, perf_end;
+    // For output buffering if needed
+    vector<char> out_buffer;
+
+    /* Get parameters for this thread before entering the main loop */
+    start = th_params.start;
+    vlen = th_params.vlen;
+    block_size = th_params.block_size;
+    params = th_params.params;
+    pc_error = th_params.pc_error;
+    stats = th_params.timing ? &th_params.stats[tid] : NULL;
+    if (stats != NULL) {
+        memset(stats, 0, sizeof(thread_stats));
+    }
+    if (params.counters != NULL) {
+        params.counters += tid * (params.prog_len / 4);
+    }
+
+    // If output buffering is needed, allocate it
+    if (th_params.need_output_buffering) {
+        out_buffer.resize(params.memsizes[0] * th_params.buffer_size);
+        params.out_buffer = &out_buffer[0];
+    } else {
+        params.out_buffer = NULL;
+    }
+
+    /* Populate private data for each thread */
+    n_inputs = params.n_inputs;
+    n_constants = params.n_constants;
+    n_temps = params.n_temps;
+    memsize = (1+n_inputs+n_constants+n_temps) * sizeof(char *);
+    /* XXX malloc seems thread safe for POSIX, but for Win? */
+    mem = (char **)malloc(memsize);
+    memcpy(mem, params.mem, memsize);
+
+    errmsg = th_params.errmsg;
+
+    params.mem = mem;
+
+    /* Loop over blocks */
+    pthread_mutex_lock(&gs.count_mutex);
+    if (!gs.init_sentinels_done) {
+        /* Set sentinels and other global variables */
+        gs.gindex = start;
+        istart = gs.gindex;
+        iend = istart + block_size;
+        if (iend > vlen) {
+            iend = vlen;
+        }
+        gs.init_sentinels_done = 1;  /* sentinels have been initialised */
+        gs.giveup = 0;            /* no giveup initially */
+    } else {
+        gs.gindex += block_size;
+        istart = gs.gindex;
+        iend = istart + block_size;
+        if (iend > vlen) {
+            iend = vlen;
+        }
+    }
+    /* Grab one of the iterators */
+    iter = th_params.iter[tid];
+    if (iter == NULL) {
+        th_params.ret_code = -1;
+        gs.giveup = 1;
+    }
+    memsteps = th_params.memsteps[tid];
+    /* Get temporary space for each thread */
+    ret = get_temps_space(params, mem, th_params.buffer_size);
+    if (ret < 0) {
+        /* Propagate error to main thread */
+        th_params.ret_code = ret;
+        gs.giveup = 1;
+    }
+    pthread_mutex_unlock(&gs.count_mutex);
+
+    if (th_params.perf) {
+        nx_perf_read(&perf_start);
+    }
+
+    while (istart < vlen && !gs.giveup) {
+        if (stats != NULL) {
+            t_task = nx_seconds();
+            stats->tasks++;
+            stats->elements += iend - istart;
+        }
+        /* Reset the iterator to the range for this task */
+        ret = NpyIter_ResetToIterIndexRange(iter, istart, iend,
+                                            errmsg);
+        /* Execute the task */
+        if (ret >= 0) {
+            ret = vm_engine_iter_task(iter, memsteps, params, pc_error, errmsg);
+        }
+        if (stats != NULL) {
+            stats->busy += nx_seconds() - t_task;
+        }
+
+        if (ret < 0) {
+            pthread_mutex_lock(&gs.count_mutex);
+            gs.giveup = 1;
+            /* Propagate error to main thread */
+            th_params.ret_code = ret;
+            pthread_mutex_unlock(&gs.count_mutex);
+            break;
+        }
+
+        pthread_mutex_lock(&gs.count_mutex);
+        gs.gindex += block_size;
+        istart = gs.gindex;
+        iend = istart + block_size;
+        if (iend > vlen) {
+            iend = vlen;
+        }
+        pthread_mutex_unlock(&gs.count_mutex);
+    }
+
+    if (th_params.perf) {
+        nx_perf_read(&perf_end);
+        nx_perf_delta(&perf_start, &perf_end, &th_params.thread_perf[tid]);
+    }
+    if (stats != NULL) {
+        th_params.done_time[tid] = nx_seconds();
+    }
+
+    /* Release resources */
+    free_temps_space(params, mem);
+    free(mem);
+}
+
+void
+nx_run_task(void *arg, int i)
+{
+    bool run;
+
+    pthread_mutex_lock(&gs.count_mutex);
+    run = (th_params.tasks_open && i >= 0 && i < th_params.nthreads &&
+           !th_params.task_ran[i]);
+    if (run) {
+        th_params.task_ran[i] = true;
+        th_params.tasks_running++;
+    }
+    pthread_mutex_unlock(&gs.count_mutex);
+    if (!run) {
+        return;
+    }
+
+#ifdef USE_VML
+    // The threads of VML would compete with the ones of the call
+    int vml_threads = numexpr_vml_auto_threads ?
+                      mkl_set_num_threads_local(1) : 0;
+#endif
+    thread_tasks(i);
+#ifdef USE_VML
+    if (numexpr_vml_auto_threads) {
+        mkl_set_num_threads_local(vml_threads);
+    }
+#endif
+
+    pthread_mutex_lock(&gs.count_mutex);
+    if (--th_params.tasks_running == 0) {
+        pthread_cond_broadcast(&gs.tasks_done_cv);
+    }
+    pthread_mutex_unlock(&gs.count_mutex);
+}
+
+/* Wake up the pool and wait for its threads to finish */
+static void
+pool_parallel(void)
+{
+    /* Synchronization point for all threads (wait for initialization) */
+    pthread_mutex_lock(&gs.count_threads_mutex);
+    if (gs.count_threads < gs.nthreads) {
+        gs.count_threads++;
+        pthread_cond_wait(&gs.count_threads_cv, &gs.count_threads_mutex);
+    }
+    else {
+        pthread_cond_broadcast(&gs.count_threads_cv);
+    }
+    pthread_mutex_unlock(&gs.count_threads_mutex);
+
+    /* Synchronization point for all threads (wait for finalization) */
+    pthread_mutex_lock(&gs.count_threads_mutex);
+    if (gs.count_threads > 0) {
+        gs.count_threads--;
+        pthread_cond_wait(&gs.count_threads_cv, &gs.count_threads_mutex);
+    }
+    else {
+        pthread_cond_broadcast(&gs.count_threads_cv);
+    }
+    pthread_mutex_unlock(&gs.count_threads_mutex);
+}
+
+/* The task given to Python callbacks, which runs without the GIL */
+static PyObject *
+py_task(PyObject *self, PyObject *args)
+{
+    int i;
+
+    if (!PyArg_ParseTuple(args, "i:task", &i)) {
+        return NULL;
+    }
+    Py_BEGIN_ALLOW_THREADS;
+    nx_run_task(NULL, i);
+    Py_END_ALLOW_THREADS;
+    Py_RETURN_NONE;
+}
+
+static PyMethodDef py_task_def = {
+    "task", py_task, METH_VARARGS,
+    "task(i): runs the tasks of thread i of the current numexpr call."
+};
+
+int
+nx_run_parallel(void)
+{
+    int i, ret = 0;
+    int nthreads = th_params.nthreads;
+    scheduler_state &sched = numexpr_scheduler;
+
+    gs.init_sentinels_done = 0;
+    memset(th_params.task_ran, 0, nthreads * sizeof(bool));
+    th_params.tasks_running = 0;
+    th_params.tasks_open = true;
+
+    if (sched.kind == NX_SCHED_CALLBACK && sched.callable != NULL) {
+        PyObject *task = PyCFunction_New(&py_task_def, NULL);
+        PyObject *res = NULL;
+        if (task != NULL) {
+            res = PyObject_CallFunction(sched.callable, (char *)"Oi",
+                                        task, nthreads);
+            Py_DECREF(task);
+        }
+        if (res == NULL) {
+            ret = -1;
+        }
+        Py_XDECREF(res);
+    }
+
+    Py_BEGIN_ALLOW_THREADS;
+
+    switch (sched.kind) {
+        case NX_SCHED_POOL:
+            pool_parallel();
+            break;
+#ifdef _OPENMP
+        case NX_SCHED_OPENMP:
+            #pragma omp parallel num_threads(nthreads)
+            nx_run_task(NULL, omp_get_thread_num());
+            break;
+#endif
+        case NX_SCHED_CALLBACK:
+            if (sched.parallel_for != NULL) {
+                sched.parallel_for(nx_run_task, NULL, nthreads,
+                                   sched.user_data);
+            }
+            break;
+    }
+
+    /* Run the thread indexes that the backend left over (if the call
+       has not failed), and wait for the ones still running */
+    if (ret == 0) {
+        for (i = 0; i < nthreads; i++) {
+            nx_run_task(NULL, i);
+        }
+    }
+    pthread_mutex_lock(&gs.count_mutex);
+    th_params.tasks_open = false;
+    while (th_params.tasks_running > 0) {
+        pthread_cond_wait(&gs.tasks_done_cv, &gs.count_mutex);
+    }
+    pthread_mutex_unlock(&gs.count_mutex);
+
+    Py_END_ALLOW_THREADS;
+
+    return ret;
+}
@@ -0,0 +1,72 @@
+#ifndef NUMEXPR_SCHEDULER_HPP
+#define NUMEXPR_SCHEDULER_HPP
+/*********************************************************************
+  Numexpr - Fast numerical array expression evaluator for NumPy.
+
+      License: MIT
+      Author:  See AUTHORS.txt
+
+  See LICENSE.txt for details about copyright and rights to use.
+**********************************************************************/
+
+/* The backends running the parallel engine of the VM.
+
+   A parallel call is split in as many task functions as threads (see
+   nx_run_task()), and every backend just has to call them, once per
+   thread index.  As the tasks (ranges of blocks) are claimed from
+   a shared index, any index that runs completes the call even if the
+   others never do, and the indexes that a backend did not run are run
+   by the calling thread at the end. */
+
+// The backends
+enum {
+    NX_SCHED_POOL,      // the pool of threads of numexpr
+    NX_SCHED_OPENMP,    // an OpenMP parallel region (if built with OpenMP)
+    NX_SCHED_CALLBACK,  // a "parallel for" of the application
+    NX_SCHED_N
+};
+
+/* A "parallel for" of the application: calls `task(arg, i)` for every
+   i in [0, n), from as many threads as it wants, and returns when all
+   the calls have returned.  It is called without the GIL. */
+typedef void (*nx_parallel_for)(void (*task)(void *arg, int i), void *arg,
+                                int n, void *user_data);
+
+/* A PyCapsule named NX_PARALLEL_FOR_CAPSULE, passed to set_scheduler(),
+   points to one of these */
+struct nx_parallel_for_def {
+    nx_parallel_for parallel_for;
+    void *user_data;
+};
+#define NX_PARALLEL_FOR_CAPSULE "numexpr.parallel_for"
+
+struct scheduler_state {
+    int kind;
+    // For NX_SCHED_CALLBACK, either a C parallel for (from a capsule)...
+    nx_parallel_for parallel_for;
+    void *user_data;
+    // ...or a Python callable, called as callable(task, n)
+    PyObject *callable;
+    // The capsule or the callable, owned
+    PyObject *object;
+};
+
+extern scheduler_state numexpr_scheduler;
+extern const char *numexpr_scheduler_names[NX_SCHED_N];
+
+// Whether VML is kept single threaded inside parallel calls
+extern int numexpr_vml_auto_threads;
+
+/* Whether a backend was compiled in */
+int nx_scheduler_available(int kind);
+
+/* Run the call set up in th_params in th_params.nthreads threads of
+   the current backend.  Must be called with the GIL held.  Returns -1
+   (with a Python exception set) if a Python callback failed. */
+int nx_run_parallel(void);
+
+/* Run the thread index `i` of the current call, unless it already ran
+   (this is the task function given to the backends) */
+void nx_run_task(void *arg, int i);
+
+#endif // NUMEXPR_SCHEDULER_HPP
@@ -0,0 +1,148 @@
+###################################################################
+#  Numexpr - Fast numerical array expression evaluator for NumPy.
+#
+#      License: MIT
+#      Author:  See AUTHORS.txt
+#
+#  See LICENSE.txt and LICENSES/*.txt for details about copyright and
+#  rights to use.
+####################################################################
+
+"""
+Evaluation of element-wise expressions over sparse matrices.
+
+When the expression maps zeros to zero, it only needs to be evaluated
+over the stored values of the sparse operands, and the outcome shares
+their index structure.  Sparse matrices are duck-typed after SciPy's
+ones (they have `format`, `data` and `shape` attributes), so SciPy is
+not a requirement of numexpr.
+"""
+
+import copy
+
+import numpy
+
+from numexpr.necompiler import (
+    getContext, getCachedExprNames, getArguments, getCachedNumExpr)
+from numexpr.chunked import _check_elementwise
+
+# The index arrays of each sparse format
+_STRUCTURE = {
+    'csr': ('indices', 'indptr'),
+    'csc': ('indices', 'indptr'),
+    'bsr': ('indices', 'indptr'),
+    'coo': ('row', 'col'),
+    'dia': ('offsets',),
+}
+
+
+def _is_sparse(a):
+    return hasattr(a, 'format') and hasattr(a, 'data') and \
+        hasattr(a, 'shape') and not isinstance(a, numpy.ndarray)
+
+
+def _canonical(m):
+    """A copy of `m` without duplicated entries (if it has any)."""
+    if m.format not in _STRUCTURE:
+        raise ValueError("sparse format '%s' is not supported" % m.format)
+    if hasattr(m, 'sum_duplicates') and \
+            not getattr(m, 'has_canonical_format', False):
+        m = m.copy()
+        m.sum_duplicates()
+    return m
+
+
+def _same_structure(m1, m2):
+    if m1.format != m2.format or m1.shape != m2.shape or \
+            m1.data.shape != m2.data.shape:
+        return False
+    for attr in _STRUCTURE[m1.format]:
+        i1, i2 = getattr(m1, attr), getattr(m2, attr)
+        if i1 is not i2 and not numpy.array_equal(i1, i2):
+            return False
+    return True
+
+
+def _with_data(m, data):
+    """A sparse matrix with the structure of `m` and the values `data`."""
+    # A shallow copy shares the index arrays
+    result = copy.copy(m)
+    result.data = data
+    return result
+
+
+def preserves_zero(ex, local_dict=None, global_dict=None, **kwargs):
+    """Whether `ex` evaluates to zero when all the sparse operands are zero.
+
+    The operands are looked up like in `evaluate()`.
+    """
+    context = getContext(kwargs, frame_depth=1)
+    expr_key, (names, ex_uses_vml) = getCachedExprNames(ex, context)
+    arguments = getArguments(names, local_dict, global_dict, frame_depth=1)
+    return _preserves_zero(ex, names, arguments, context, expr_key,
+                           ex_uses_vml)
+
+
+def _preserves_zero(ex, names, arguments, context, expr_key, ex_uses_vml):
+    zeros = [numpy.zeros((), dtype=a.dtype) if _is_sparse(a)
+             else numpy.asarray(a) for a in arguments]
+    compiled_ex = getCachedNumExpr(ex, expr_key, names, zeros, context)
+    _check_elementwise(compiled_ex)
+    with numpy.errstate(all='ignore'):
+        value = compiled_ex(*zeros, ex_uses_vml=ex_uses_vml)
+    return value.shape == () and not value
+
+
+def evaluate_sparse(ex, local_dict=None, global_dict=None, densify=False,
+                    order='K', casting='safe', **kwargs):
+    """Evaluate an element-wise expression over sparse matrices.
+
+    The operands must be sparse matrices sharing the same structure
+    (the same stored positions) and scalars.  If the expression maps
+    zero to zero (see `preserves_zero()`), it is only evaluated over
+    the stored values, and the outcome is a sparse matrix sharing the
+    index arrays of the operands.
+
+    Otherwise, a ValueError is raised, unless `densify` is true: the
+    expression is then evaluated over the dense form of the operands
+    and a dense array is returned.
+
+    See `evaluate()` for the rest of parameters.
+    """
+    if not isinstance(ex, (str, unicode)):
+        raise ValueError("must specify expression as a string")
+    context = getContext(kwargs, frame_depth=1)
+    expr_key, (names, ex_uses_vml) = getCachedExprNames(ex, context)
+    arguments = getArguments(names, local_dict, global_dict, frame_depth=1)
+    kwargs = {'order': order, 'casting': casting, 'ex_uses_vml': ex_uses_vml}
+
+    matrices = [a for a in arguments if _is_sparse(a)]
+    if not matrices:
+        raise ValueError("no sparse operand in expression")
+    for a in arguments:
+        if not _is_sparse(a) and numpy.ndim(a) != 0:
+            raise ValueError("the operands must be sparse matrices "
+                             "or scalars")
+
+    if not _preserves_zero(ex, names, arguments, context, expr_key,
+                           ex_uses_vml):
+        if not densify:
+            raise ValueError("expression does not map zero to zero, so "
+                             "its outcome would be dense (use densify)")
+        dense = [a.toarray() if _is_sparse(a) else numpy.asarray(a)
+                 for a in arguments]
+        compiled_ex = getCachedNumExpr(ex, expr_key, names, dense, context)
+        return compiled_ex(*dense, **kwargs)
+
+    canonical = {}
+    for m in matrices:
+        if id(m) not in canonical:
+            canonical[id(m)] = _canonical(m)
+    first = canonical[id(matrices[0])]
+    for m in canonical.values():
+        if not _same_structure(first, m):
+            raise ValueError("sparse operands must have the same structure")
+    values = [canonical[id(a)].data if _is_sparse(a) else numpy.asarray(a)
+              for a in arguments]
+    compiled_ex = getCachedNumExpr(ex, expr_key, names, values, context)
+    return _with_data(first, compiled_ex(*values, **kwargs))
@@ -11,9 +11,12 @@ from __future__ import absolute_import, print_function
 
 import os
 import sys
+import json
 import platform
 import warnings
+import threading
 from contextlib import contextmanager
+from StringIO import StringIO
 
 import numpy as np
 from numpy import (
@@ -27,8 +30,13 @@ from numpy.testing import (assert_equal, assert_array_equal,
                            assert_array_almost_equal, assert_allclose)
 from numpy import shape, allclose, array_equal, ravel, isnan, isinf
 
+try:
+    import scipy.sparse as scipy_sparse
+except ImportError:
+    scipy_sparse = None
+
 import numexpr
-from numexpr import E, NumExpr, evaluate, disassemble, use_vml
+from numexpr import E, NumExpr, evaluate, disassemble, use_vml, interpreter
 
 import unittest
 
@@ -814,6 +822,889 @@ class test_zerodim(TestCase):
         assert_array_equal(r1, a1)
 
 
+# Cases for evaluating expressions in chunks of rows
+class test_chunked(TestCase):
+    def test_in_memory(self):
+        a = arange(1e5).reshape(1000, 100)
+        b = arange(100.)
+        res = numexpr.evaluate_chunked('2*a + b', chunklen=64)
+        assert_array_equal(res, 2 * a + b)
+
+    def test_memmap(self):
+        import tempfile
+        tmpdir = tempfile.mkdtemp()
+        try:
+            fname = os.path.join(tmpdir, 'a.bin')
+            a = np.memmap(fname, dtype='f8', mode='w+', shape=(100000,))
+            a[:] = arange(1e5)
+            oname = os.path.join(tmpdir, 'out.bin')
+            out = np.memmap(oname, dtype='f8', mode='w+', shape=(100000,))
+            res = numexpr.evaluate_chunked('a*a + 1', out=out,
+                                           chunklen=1000, max_dirty=2**14)
+            self.assertTrue(res is out)
+            assert_array_equal(out, arange(1e5) ** 2 + 1)
+            del a, out, res
+        finally:
+            import shutil
+            shutil.rmtree(tmpdir)
+
+    def test_empty(self):
+        a = arange(0.)
+        assert_array_equal(numexpr.evaluate_chunked('a + 1'), a + 1)
+
+    def test_reduction(self):
+        a = arange(10.)
+        self.assertRaises(NotImplementedError,
+                          numexpr.evaluate_chunked, 'sum(a)',
+                          local_dict={'a': a})
+
+    def test_files(self):
+        import tempfile
+        tmpdir = tempfile.mkdtemp()
+        try:
+            a = arange(1e5).reshape(1000, 100)
+            aname = os.path.join(tmpdir, 'a.npy')
+            np.save(aname, a)
+            b = arange(100, dtype='f4')
+            bname = os.path.join(tmpdir, 'b.bin')
+            b.tofile(bname)
+            fa = numexpr.FileArray(aname)
+            fb = numexpr.FileArray(bname, dtype='f4', raw=True)
+            self.assertEqual(fa.shape, a.shape)
+            self.assertEqual(fb.shape, b.shape)
+            # In memory outcome
+            res = numexpr.evaluate_chunked('2*fa + fb', chunklen=64)
+            assert_array_equal(res, 2 * a + b)
+            # Outcome in a .npy file
+            oname = os.path.join(tmpdir, 'out.npy')
+            out = numexpr.FileArray(oname, mode='w')
+            res = evaluate('2*fa + fb', out=out)
+            self.assertTrue(res is out)
+            assert_array_equal(np.load(oname), 2 * a + b)
+            assert_array_equal(out.read(), 2 * a + b)
+            # Outcome handed to a callback
+            chunks = []
+            res = numexpr.evaluate_chunked(
+                'fa - 1', chunklen=300,
+                out=lambda start, stop, chunk: chunks.append(
+                    (start, stop, chunk.copy())))
+            self.assertTrue(res is None)
+            self.assertEqual([c[:2] for c in chunks],
+                             [(0, 300), (300, 600), (600, 900), (900, 1000)])
+            assert_array_equal(np.concatenate([c[2] for c in chunks]), a - 1)
+        finally:
+            import shutil
+            shutil.rmtree(tmpdir)
+
+    def test_iterevaluate(self):
+        a = arange(1000.)
+        chunks = list(numexpr.iterevaluate('a + 1', chunklen=300,
+                                           nbuffers=1))
+        self.assertEqual([len(c) for c in chunks], [300, 300, 300, 100])
+        # All the chunks share the same buffer
+        self.assertTrue(chunks[1].base is chunks[0])
+        assert_array_equal(chunks[3], a[900:] + 1)
+        chunks = [c.copy() for c in
+                  numexpr.iterevaluate('a + 1', chunklen=300)]
+        assert_array_equal(np.concatenate(chunks), a + 1)
+        # Outcomes without rows
+        chunks = list(numexpr.iterevaluate('a + 1',
+                                           local_dict={'a': a[:0]}))
+        self.assertEqual(len(chunks), 1)
+
+    def test_truncated_file(self):
+        import tempfile
+        fd, fname = tempfile.mkstemp()
+        try:
+            os.write(fd, arange(10.).tostring())
+            os.close(fd)
+            fa = numexpr.FileArray(fname, dtype='f8', shape=(20,), raw=True)
+            self.assertRaises(IOError, numexpr.evaluate_chunked, 'fa + 1',
+                              local_dict={'fa': fa}, chunklen=5)
+        finally:
+            os.remove(fname)
+
+
+# Cases for compressed arrays
+class test_carray(TestCase):
+    def test_roundtrip(self):
+        for dtype in ('b1', 'i4', 'i8', 'f4', 'f8', 'c16', 'S3'):
+            a = arange(10000).astype(dtype)
+            for shuffle in (True, False):
+                ca = numexpr.CArray(a, blocklen=3000, shuffle=shuffle)
+                self.assertEqual(len(ca.blocks), 4)
+                assert_array_equal(np.asarray(ca), a)
+
+    def test_compression(self):
+        a = arange(1e6)
+        ca = numexpr.CArray(a)
+        self.assertTrue(ca.cbytes < ca.nbytes / 4)
+        # Not compressible data is stored as is
+        r = np.random.RandomState(0).random_sample(1000)
+        ca = numexpr.CArray(r)
+        self.assertTrue(ca.cbytes <= ca.nbytes + len(ca.blocks))
+        assert_array_equal(np.asarray(ca), r)
+
+    def test_corrupted(self):
+        a = arange(1000.)
+        block = numexpr.CArray(a).blocks[0]
+        out = np.empty_like(a)
+        self.assertRaises(ValueError, interpreter._decompress,
+                          block[:len(block) // 2], out)
+        self.assertRaises(ValueError, interpreter._decompress,
+                          block, out[:-1])
+
+    def test_evaluate(self):
+        a = arange(1e5).reshape(1000, 100)
+        b = arange(100.)
+        ca = numexpr.CArray(a, blocklen=64)
+        cb = numexpr.CArray(b, blocklen=7)
+        assert_array_equal(evaluate('2*ca + cb'), 2 * a + b)
+        # Chunks not aligned with the blocks
+        res = numexpr.evaluate_chunked('2*ca + cb', chunklen=100)
+        assert_array_equal(res, 2 * a + b)
+
+
+# Cases for incremental evaluation
+class test_incremental(TestCase):
+    def test_elementwise(self):
+        a = arange(1000.)
+        b = 3.
+        inc = numexpr.Incremental('2*a + b')
+        for n in (0, 10, 10, 100, 1000):
+            res = inc.refresh({'a': a[:n], 'b': b})
+            assert_array_equal(res, 2 * a[:n] + b)
+        self.assertEqual(inc.nrows, 1000)
+        self.assertRaises(ValueError, inc.refresh, {'a': a[:10], 'b': b})
+
+    def test_sum(self):
+        a = arange(1000, dtype='i4')
+        inc = numexpr.Incremental('sum(a*2)')
+        for n in (1, 10, 500, 1000):
+            res = inc.refresh({'a': a[:n]})
+            self.assertEqual(res, 2 * a[:n].sum())
+
+    def test_prod_axis0(self):
+        a = arange(1, 61, dtype='f8').reshape(20, 3) / 10
+        inc = numexpr.Incremental('prod(a, axis=0)')
+        for n in (5, 20):
+            res = inc.refresh({'a': a[:n]})
+            assert_allclose(res, a[:n].prod(axis=0))
+
+    def test_rowwise_reduction(self):
+        a = arange(60.).reshape(20, 3)
+        inc = numexpr.Incremental('sum(a, axis=1)')
+        for n in (5, 20):
+            res = inc.refresh({'a': a[:n]})
+            assert_array_equal(res, a[:n].sum(axis=1))
+
+    def test_reset(self):
+        a = arange(10.)
+        inc = numexpr.Incremental('a + 1')
+        inc.refresh({'a': a})
+        inc.reset()
+        assert_array_equal(inc.refresh({'a': a[:5] * 2}), a[:5] * 2 + 1)
+
+
+# Cases for the cache of outcomes
+class test_result_cache(TestCase):
+    def setUp(self):
+        self.old_size = numexpr.set_result_cache_size(2 ** 20)
+
+    def tearDown(self):
+        numexpr.set_result_cache_size(0)
+        numexpr.set_result_cache_size(self.old_size)
+
+    def test_hit(self):
+        a = arange(1000.)
+        r1 = evaluate('a * 2 + 1')
+        r2 = evaluate('a * 2 + 1')
+        self.assertTrue(r1 is r2)
+        self.assertFalse(r1.flags.writeable)
+        # Other scalars, views or versions are not hits
+        r3 = evaluate('a * 3 + 1')
+        self.assertTrue(r3 is not r1)
+        assert_array_equal(r3, a * 3 + 1)
+        b = a[::2]
+        assert_array_equal(evaluate('a * 2 + 1', {'a': b}), b * 2 + 1)
+        self.assertTrue(evaluate('a * 2 + 1', cache_version=1) is not r1)
+
+    def test_modified(self):
+        a = arange(1000.)
+        r1 = evaluate('a + 1')
+        a[0] = 10
+        numexpr.mark_modified(a[:5])
+        r2 = evaluate('a + 1')
+        self.assertTrue(r2 is not r1)
+        self.assertEqual(r2[0], 11)
+
+    def test_bounded(self):
+        a = arange(10000.)
+        b = arange(10000.)
+        numexpr.set_result_cache_size(100000)
+        r1 = evaluate('a + 1')
+        r2 = evaluate('b + 1')
+        self.assertTrue(evaluate('b + 1') is r2)
+        self.assertTrue(evaluate('a + 1') is not r1)
+        # Too large outcomes are not cached
+        c = arange(20000.)
+        self.assertTrue(evaluate('c + 1').flags.writeable)
+
+    def test_out(self):
+        a = arange(10.)
+        out = np.empty_like(a)
+        evaluate('a + 1', out=out)
+        evaluate('a + 1', out=out)
+        self.assertTrue(out.flags.writeable)
+
+    def test_out_modifies(self):
+        a = arange(5.)
+        r1 = evaluate('a * 2')
+        evaluate('a + 1', out=a)
+        r2 = evaluate('a * 2')
+        self.assertTrue(r2 is not r1)
+        assert_array_equal(r2, arange(1., 6.) * 2)
+        # The stale entries are evicted
+        self.assertEqual(len(numexpr.utils.result_cache.entries), 1)
+
+
+# Cases for structured arrays
+class test_records(TestCase):
+    def setUp(self):
+        dtype = [('id', 'i4'), ('price', 'f8'), ('qty', 'i2'),
+                 ('flag', '?'), ('name', 'S5'), ('xy', 'f4', (2,))]
+        self.rec = np.zeros(10000, dtype=dtype)
+        self.rec['id'] = arange(10000)
+        self.rec['price'] = arange(10000) / 10.
+        self.rec['qty'] = arange(10000) % 7
+        self.rec['flag'] = arange(10000) % 3 == 0
+
+    def test_fields(self):
+        rec = self.rec
+        res = numexpr.evaluate_records('price * qty + id', rec,
+                                       chunklen=999)
+        assert_array_equal(res, rec['price'] * rec['qty'] + rec['id'])
+        res = numexpr.evaluate_records('where(flag, price, 0)', rec)
+        assert_array_equal(res, np.where(rec['flag'], rec['price'], 0))
+
+    def test_other_names(self):
+        rec = self.rec
+        scale = 2.5
+        res = numexpr.evaluate_records('price * scale', rec)
+        assert_array_equal(res, rec['price'] * scale)
+        res = numexpr.evaluate_records('price * w', rec,
+                                       local_dict={'w': rec['id']})
+        assert_array_equal(res, rec['price'] * rec['id'])
+
+    def test_strided_records(self):
+        rec = self.rec[::3]
+        res = numexpr.evaluate_records('price - qty', rec, chunklen=100)
+        assert_array_equal(res, rec['price'] - rec['qty'])
+
+    def test_deinterleave(self):
+        rec = self.rec
+        fields = rec.dtype.fields
+        outs = (np.empty(10, 'S5'), np.empty(10, 'f8'))
+        offsets = (fields['name'][1], fields['price'][1])
+        interpreter._deinterleave(rec, offsets, outs, 20)
+        assert_array_equal(outs[1], rec['price'][20:30])
+        self.assertRaises(IndexError, interpreter._deinterleave,
+                          rec, offsets, outs, 9995)
+
+
+# Cases for tiled evaluation
+class test_tiled(TestCase):
+    def test_outer(self):
+        a = arange(1000.)
+        b = arange(700.) * 2
+        ac = a[:, np.newaxis]
+        res = numexpr.evaluate_tiled('(ac - b)**2', tile=(64, 100))
+        assert_array_equal(res, (ac - b) ** 2)
+        res = numexpr.evaluate_tiled('(ac - b)**2 + 1')
+        assert_array_equal(res, (ac - b) ** 2 + 1)
+
+    def test_mixed_layouts(self):
+        c = arange(300 * 200.).reshape(300, 200)
+        f = np.asfortranarray(c * 3)
+        res = numexpr.evaluate_tiled('c + f', tile=(50, 30))
+        assert_array_equal(res, c + f)
+        res = numexpr.evaluate_tiled('f * 2', tile=(50, 30))
+        self.assertTrue(res.flags.f_contiguous)
+        assert_array_equal(res, f * 2)
+        out = np.empty((300, 200), dtype='f8')
+        self.assertTrue(numexpr.evaluate_tiled('c - f', out=out) is out)
+        assert_array_equal(out, c - f)
+
+    def test_not_2d(self):
+        a = arange(10.)
+        self.assertRaises(ValueError, numexpr.evaluate_tiled, 'a + 1',
+                          local_dict={'a': a})
+        b = a.reshape(2, 5)
+        self.assertRaises(NotImplementedError, numexpr.evaluate_tiled,
+                          'sum(b)', local_dict={'b': b})
+
+    def test_empty(self):
+        a = np.empty((0, 5))
+        res = numexpr.evaluate_tiled('a + 1', local_dict={'a': a})
+        self.assertEqual(res.shape, (0, 5))
+
+
+# Cases for sparse matrices (only run if SciPy is available)
+class test_sparse(TestCase):
+    def setUp(self):
+        self.x = scipy_sparse.random(200, 300, density=0.05, format='csr',
+                                     random_state=0)
+        self.x.sum_duplicates()
+        self.w = self.x.copy()
+        self.w.data = np.arange(self.x.nnz, dtype='f8')
+
+    def test_preserving(self):
+        x, w = self.x, self.w
+        res = numexpr.evaluate_sparse('log1p(x) * w')
+        self.assertEqual(res.format, 'csr')
+        # The index arrays are shared with one of the operands
+        self.assertTrue(res.indices is x.indices or res.indices is w.indices)
+        assert_allclose(res.toarray(), np.log1p(x.toarray()) * w.toarray())
+        for fmt in ('csc', 'coo'):
+            y = x.asformat(fmt)
+            res = numexpr.evaluate_sparse('sin(y) * 2')
+            assert_allclose(res.toarray(), np.sin(x.toarray()) * 2)
+
+    def test_not_preserving(self):
+        x = self.x
+        self.assertFalse(numexpr.preserves_zero('cos(x)'))
+        self.assertTrue(numexpr.preserves_zero('x**2'))
+        self.assertRaises(ValueError, numexpr.evaluate_sparse, 'x + 1',
+                          local_dict={'x': x})
+        res = numexpr.evaluate_sparse('x + 1', local_dict={'x': x},
+                                      densify=True)
+        assert_array_equal(res, x.toarray() + 1)
+
+    def test_duplicates(self):
+        y = scipy_sparse.coo_matrix(([1., 2., 3.], ([0, 0, 1], [1, 1, 2])),
+                                    shape=(2, 3))
+        res = numexpr.evaluate_sparse('y**2', local_dict={'y': y})
+        assert_array_equal(res.toarray(), y.toarray() ** 2)
+
+    def test_structure_mismatch(self):
+        x = self.x
+        z = scipy_sparse.random(200, 300, density=0.05, format='csr',
+                                random_state=1)
+        self.assertRaises(ValueError, numexpr.evaluate_sparse, 'x * z',
+                          local_dict={'x': x, 'z': z})
+
+
+# Cases for the 3-vector functions
+class test_vectors(TestCase):
+    def setUp(self):
+        self.a = np.linspace(-1, 1, 3000).reshape(1000, 3)
+        self.b = np.cos(arange(3000.)).reshape(1000, 3)
+
+    def test_functions(self):
+        a, b = self.a, self.b
+        assert_allclose(evaluate('dot(a, b)'), (a * b).sum(axis=1))
+        assert_allclose(evaluate('norm(a)'), np.sqrt((a * a).sum(axis=1)))
+        assert_allclose(evaluate('cross(a, b)'), np.cross(a, b))
+        assert_allclose(evaluate('norm(cross(a, b)) / norm(a) + 1'),
+                        np.sqrt((np.cross(a, b) ** 2).sum(axis=1)) /
+                        np.sqrt((a * a).sum(axis=1)) + 1)
+
+    def test_operands(self):
+        a = self.a
+        # Broadcast, strided, Fortran ordered and integer vectors
+        z = np.array([0., 0., 1.])
+        assert_allclose(evaluate('dot(a, z)'), a[:, 2])
+        w = np.hstack([self.b, a])[:, 3:]
+        assert_allclose(evaluate('cross(w, a)'), np.cross(w, a))
+        f = np.asfortranarray(a)
+        assert_allclose(evaluate('dot(f, f)'), (a * a).sum(axis=1))
+        i = arange(3000).reshape(1000, 3)
+        assert_allclose(evaluate('dot(i, a)'), (i * a).sum(axis=1))
+        x = a.reshape(10, 100, 3)
+        self.assertEqual(evaluate('norm(x)').shape, (10, 100))
+
+    def test_operand_names(self):
+        # Operands named as the vector functions still work, unless called
+        norm = arange(3.)
+        dot = arange(3.) + 1
+        cross = self.a
+        assert_array_equal(evaluate('norm*2'), norm * 2)
+        assert_array_equal(evaluate('dot + norm'), dot + norm)
+        assert_allclose(evaluate('norm(cross) + dot', {'cross': cross,
+                                                       'dot': 1.5}),
+                        np.sqrt((cross * cross).sum(axis=1)) + 1.5)
+
+    def test_out(self):
+        a, b = self.a, self.b
+        out = np.empty((1000, 3))
+        self.assertTrue(evaluate('cross(a, b)', out=out) is out)
+        assert_allclose(out, np.cross(a, b))
+
+    def test_errors(self):
+        a = self.a
+        self.assertRaises(TypeError, evaluate, 'a + norm(a)',
+                          local_dict={'a': a})
+        self.assertRaises(TypeError, evaluate, 'cross(a, a) * 2',
+                          local_dict={'a': a})
+        self.assertRaises(ValueError, evaluate, 'norm(c)',
+                          local_dict={'c': np.ones((4, 2))})
+
+
+# Cases for the instruction counters of the VM
+class test_profile(TestCase):
+    def setUp(self):
+        numexpr.set_profiling(True)
+
+    def tearDown(self):
+        numexpr.set_profiling(False)
+
+    def test_counters(self):
+        a = arange(1e5)
+        b = arange(1e5) * 2
+        ex = 'a*b + 3*a'
+        numexpr.profile(ex, reset=True)
+        evaluate(ex)
+        evaluate(ex)
+        rows = numexpr.profile(ex)
+        # The registers may be allocated differently on every compilation
+        func = NumExpr(ex, [('a', double), ('b', double)])
+        self.assertEqual([row[0][0] for row in rows],
+                         [instruction[0] for instruction in disassemble(func)])
+        for instruction, calls, elements, ticks in rows:
+            self.assertTrue(calls > 0)
+            self.assertEqual(elements, 2 * len(a))
+        self.assertTrue(sum(row[3] for row in rows) > 0)
+        # Reset after reading
+        numexpr.profile(ex, reset=True)
+        self.assertEqual(numexpr.profile(ex)[0][1:], (0, 0, 0))
+
+    def test_disabled(self):
+        a = arange(1e4)
+        func = NumExpr('a + 1', [('a', double)])
+        numexpr.set_profiling(False)
+        func(a)
+        self.assertEqual(numexpr.profile(func), [
+            (row, 0, 0, 0) for row in disassemble(func)])
+        numexpr.set_profiling(True)
+        func(a)
+        self.assertEqual(numexpr.profile(func, reset=True)[0][2], len(a))
+
+
+# Cases for the timing of the phases of the calls
+class test_timing(TestCase):
+    def setUp(self):
+        numexpr.get_timings(reset=True)
+        numexpr.set_timing(True)
+
+    def tearDown(self):
+        numexpr.set_timing(False)
+        numexpr.get_timings(reset=True)
+
+    def test_phases(self):
+        a = arange(1e5)
+        evaluate('2*a + 1')
+        evaluate('2*a + 1')
+        evaluate('sum(a)')
+        timings = numexpr.get_timings()
+        self.assertEqual(len(timings['calls']), 3)
+        record = timings['calls'][0]
+        self.assertEqual(record['expression'], '2*a + 1')
+        self.assertEqual(record['size'], len(a))
+        for phase in ('parse', 'setup', 'copies', 'compute', 'barrier',
+                      'finalize'):
+            self.assertTrue(0 <= record[phase] <= record['total'])
+        self.assertTrue(record['compute'] > 0)
+        totals = timings['expressions']['2*a + 1']
+        self.assertEqual(totals['calls'], 2)
+        self.assertTrue(totals['total'] >= record['total'])
+        self.assertEqual(timings['expressions']['sum(a)']['calls'], 1)
+
+    def test_json(self):
+        a = arange(10.)
+        evaluate('a + 1')
+        f = StringIO()
+        numexpr.dump_timings(f, reset=True)
+        timings = json.loads(f.getvalue())
+        self.assertEqual(timings['expressions']['a + 1']['calls'], 1)
+        self.assertEqual(numexpr.get_timings()['calls'], [])
+
+    def test_disabled(self):
+        numexpr.set_timing(False)
+        a = arange(10.)
+        evaluate('a + 1')
+        self.assertEqual(numexpr.get_timings()['calls'], [])
+
+    def test_thread_stats(self):
+        numexpr.get_thread_stats(reset=True)
+        a = arange(1e6)
+        nthreads = numexpr.set_num_threads(2)
+        try:
+            evaluate('2*a + 1')
+            evaluate('2*a + 1')
+        finally:
+            numexpr.set_num_threads(nthreads)
+        stats = numexpr.get_thread_stats(reset=True)
+        self.assertEqual(len(stats['last']), 2)
+        self.assertEqual(sum(s['elements'] for s in stats['last']), len(a))
+        self.assertEqual(sum(s['tasks'] for s in stats['total']),
+                         2 * sum(s['tasks'] for s in stats['last']))
+        for s in stats['total']:
+            self.assertEqual(s['calls'], 2)
+            self.assertTrue(s['busy'] >= 0 and s['idle'] >= 0 and
+                            s['barrier'] >= 0)
+        self.assertTrue(stats['imbalance'] >= 1)
+        record = numexpr.get_timings()['calls'][-1]
+        self.assertEqual(record['nthreads'], 2)
+        self.assertTrue(record['imbalance'] >= 1)
+        self.assertEqual(numexpr.get_thread_stats()['total'], [])
+
+
+class test_perf_counters(TestCase):
+    def setUp(self):
+        numexpr.set_perf_counters(True)
+
+    def tearDown(self):
+        numexpr.set_perf_counters(False)
+
+    def test_counters(self):
+        a = arange(1e5)
+        ex = NumExpr('2*a + 1', [('a', double)])
+        ex(a)
+        ex(a)
+        counters = numexpr.perf_counters(ex, reset=True)
+        self.assertEqual(counters['calls'], 2)
+        self.assertEqual(counters['elements'], 2 * len(a))
+        available = numexpr.perf_counters_available()
+        for name in numexpr.utils.perf_counter_names:
+            if name in available:
+                self.assertTrue(counters[name] >= 0)
+            else:
+                # Unsupported counters are reported, but not valid
+                self.assertEqual(counters[name], None)
+        if 'instructions' in available:
+            self.assertTrue(counters['instructions'] > len(a))
+        self.assertEqual(numexpr.perf_counters(ex)['calls'], 0)
+
+    def test_threads(self):
+        a = arange(1e6)
+        nthreads = numexpr.set_num_threads(2)
+        try:
+            evaluate('2*a + 1')
+            counters = numexpr.perf_counters('2*a + 1')
+        finally:
+            numexpr.set_num_threads(nthreads)
+        self.assertTrue(counters['calls'] >= 1)
+        self.assertEqual(len(numexpr.get_thread_perf_counters()), 2)
+
+    def test_disabled(self):
+        numexpr.set_perf_counters(False)
+        ex = NumExpr('a + 1', [('a', double)])
+        ex(arange(10.))
+        self.assertEqual(numexpr.perf_counters(ex)['calls'], 0)
+
+
+class test_cost(TestCase):
+    def test_elementwise(self):
+        a = arange(1000.)
+        b = arange(1000.)
+        cost = numexpr.analyze('2*a + b')
+        self.assertEqual([i['instruction'][0] for i in cost['instructions']],
+                         [b'mul_ddd', b'add_ddd'])
+        self.assertEqual(cost['memory_read'], 16)
+        self.assertEqual(cost['memory_written'], 8)
+        self.assertEqual(cost['flops'], 2)
+        self.assertEqual(cost['intensity'], 2. / 24)
+        self.assertEqual(cost['elements'], 1000)
+        # The constant is not read from memory
+        self.assertEqual(cost['instructions'][0]['bytes_read'], 8)
+        self.assertEqual(cost['bottleneck'], None)
+
+    def test_bottleneck(self):
+        a = arange(1000.)
+        cost = numexpr.analyze('a + 1', bandwidth=1e10, flop_rate=1e10)
+        self.assertEqual(cost['bottleneck'], 'memory')
+        self.assertEqual(cost['memory_time'], 16 / 1e10)
+        cost = numexpr.analyze('sin(a)**2 + cos(a)**2', bandwidth=1e10,
+                               flop_rate=1e10)
+        self.assertEqual(cost['bottleneck'], 'compute')
+        # Every temporary takes a block of doubles per thread
+        self.assertTrue(cost['temporaries'] > 0)
+        self.assertEqual(cost['temporaries'] % (8 * interpreter.block_size), 0)
+
+    def test_reduction(self):
+        a = arange(1000, dtype='float32')
+        cost = numexpr.analyze('sum(a)')
+        self.assertEqual(cost['memory_read'], 4)
+        self.assertEqual(cost['memory_written'], 0)
+
+    def test_extra_arguments(self):
+        # The third operand of where() is in the following instruction
+        a = arange(1000.)
+        b = arange(1000, dtype='int32')
+        cost = numexpr.analyze('where(a > 0, a, b)')
+        self.assertEqual(cost['memory_read'], 12)
+        self.assertEqual(cost['instructions'][-1]['bytes_read'], 17)
+
+    def test_numexpr_object(self):
+        ex = NumExpr('a*b', [('a', double), ('b', double)])
+        cost = numexpr.analyze(ex)
+        self.assertEqual(cost['memory_read'], 16)
+        self.assertEqual(cost['elements'], None)
+
+
+class test_memory(TestCase):
+    def tearDown(self):
+        numexpr.set_memory_cap(None)
+
+    def test_usage(self):
+        a = arange(1e5)
+        ex = NumExpr('sin(a)*2 + cos(a)*3', [('a', double)])
+        usage = numexpr.memory_usage(ex)
+        # The constants are allocated with the compiled expression
+        self.assertTrue(usage['current']['constants'] > 0)
+        self.assertEqual(usage['peak']['temporaries'], 0)
+        ex(a)
+        usage = numexpr.memory_usage(ex)
+        self.assertEqual(usage['current']['temporaries'], 0)
+        self.assertTrue(usage['peak']['temporaries'] > 0)
+        self.assertTrue(usage['peak']['buffers'] > 0)
+        self.assertTrue(usage['peak_total'] >= usage['peak']['temporaries'])
+        usage = numexpr.get_memory_usage()
+        self.assertTrue(usage['current']['constants'] > 0)
+        self.assertTrue(usage['peak']['temporaries'] > 0)
+
+    def test_cap_threads(self):
+        a = arange(1e6)
+        ex = NumExpr('sin(a)*2 + cos(a)*3', [('a', double)])
+        nthreads = numexpr.set_num_threads(4)
+        try:
+            ex(a)
+            peak = numexpr.memory_usage(ex, reset=True)['peak']
+            per_thread = (peak['temporaries'] + peak['buffers']) // 4
+            current = numexpr.get_memory_usage()['current']
+            numexpr.set_memory_cap(sum(list(current.values())) + 2 * per_thread)
+            numexpr.set_timing(True)
+            try:
+                assert_array_almost_equal(ex(a), sin(a)*2 + cos(a)*3)
+                self.assertEqual(ex.get_timing()['nthreads'], 2)
+            finally:
+                numexpr.set_timing(False)
+        finally:
+            numexpr.set_num_threads(nthreads)
+
+    def test_cap_blocks(self):
+        a = arange(1e5)
+        ex = NumExpr('sin(a)*2 + cos(a)*3', [('a', double)])
+        ex(a)
+        peak = numexpr.memory_usage(ex, reset=True)['peak']['temporaries']
+        numexpr.set_memory_cap(1)
+        assert_array_almost_equal(ex(a), sin(a)*2 + cos(a)*3)
+        capped = numexpr.memory_usage(ex)['peak']['temporaries']
+        self.assertTrue(0 < capped < peak)
+        self.assertEqual(numexpr.set_memory_cap(None), 1)
+
+
+class test_scheduler(TestCase):
+    def setUp(self):
+        self.nthreads = numexpr.set_num_threads(2)
+        self.a = arange(1e5)
+        self.ex = NumExpr('sin(a)*2 + a', [('a', double)])
+        self.expected = sin(self.a)*2 + self.a
+
+    def tearDown(self):
+        numexpr.set_scheduler('pool')
+        numexpr.set_num_threads(self.nthreads)
+
+    def test_available(self):
+        self.assertTrue('pool' in numexpr.schedulers)
+        self.assertTrue('callback' in numexpr.schedulers)
+        self.assertRaises(ValueError, numexpr.set_scheduler, 'tbb')
+        self.assertRaises(ValueError, numexpr.set_scheduler, 'callback')
+        self.assertEqual(numexpr.get_scheduler(), 'pool')
+        if 'openmp' in numexpr.schedulers:
+            numexpr.set_scheduler('openmp')
+            assert_array_almost_equal(self.ex(self.a), self.expected)
+        else:
+            self.assertRaises(ValueError, numexpr.set_scheduler, 'openmp')
+
+    def test_callback(self):
+        calls = []
+
+        def parallel_for(task, n):
+            calls.append(n)
+            workers = [threading.Thread(target=task, args=(i,))
+                       for i in range(n)]
+            for worker in workers:
+                worker.start()
+            for worker in workers:
+                worker.join()
+
+        self.assertEqual(numexpr.set_scheduler('callback', parallel_for),
+                         'pool')
+        self.assertEqual(numexpr.get_scheduler(), 'callback')
+        assert_array_almost_equal(self.ex(self.a), self.expected)
+        assert_array_almost_equal(evaluate('sin(a)*2 + a', {'a': self.a}),
+                                  self.expected)
+        self.assertEqual(calls, [2, 2])
+
+    def test_partial_callback(self):
+        # The tasks left over are run by the calling thread
+        numexpr.set_scheduler('callback', lambda task, n: task(0))
+        assert_array_almost_equal(self.ex(self.a), self.expected)
+
+    def test_failing_callback(self):
+        def parallel_for(task, n):
+            raise ZeroDivisionError("no threads today")
+
+        numexpr.set_scheduler('callback', parallel_for)
+        self.assertRaises(ZeroDivisionError, lambda: self.ex(self.a))
+        numexpr.set_scheduler('pool')
+        assert_array_almost_equal(self.ex(self.a), self.expected)
+
+
+class test_tails(TestCase):
+    def test_sizes(self):
+        # Tails run in multiples of a few elements plus a rest
+        for n in list(range(40)) + [1023, 1025, 1040, 2049]:
+            a = arange(n) * 0.5 + 1
+            b = arange(2*n, dtype='float32')[::2]
+            i = arange(n, dtype='int32')
+            assert_array_almost_equal(evaluate('a*b + sin(a)'),
+                                      a*b + sin(a))
+            assert_array_equal(evaluate('i % 3 + i'), i % 3 + i)
+            assert_array_equal(evaluate('where(a > 4, i, -i)'),
+                               where(a > 4, i, -i))
+            assert_allclose(evaluate('sum(a*b)'), sum(a*b))
+
+
+class test_pipelining(TestCase):
+    def setUp(self):
+        self.nthreads = numexpr.set_num_threads(1)
+        numexpr.set_pipelined_buffering(True)
+
+    def tearDown(self):
+        numexpr.set_pipelined_buffering(False)
+        numexpr.set_num_threads(self.nthreads)
+        numexpr.set_memory_cap(None)
+
+    def buffers_peak(self, ex, local_dict, pipelined, **kwargs):
+        # The pipelined calls account for their larger buffers
+        numexpr.set_pipelined_buffering(pipelined)
+        numexpr.get_memory_usage(reset=True)
+        res = evaluate(ex, local_dict, **kwargs)
+        if kwargs.get('out') is not None:
+            res = kwargs['out']
+        return res.copy(), numexpr.get_memory_usage()['peak']['buffers']
+
+    def assert_pipelined(self, ex, local_dict, **kwargs):
+        expected, serial = self.buffers_peak(ex, local_dict, False, **kwargs)
+        res, pipelined = self.buffers_peak(ex, local_dict, True, **kwargs)
+        self.assertTrue(pipelined > serial)
+        assert_array_equal(res, expected)
+
+    def test_buffered(self):
+        n = 100003
+        a = arange(n, dtype='float32')
+        b = linspace(0, 1, n)
+        s = b.astype('>f8')
+        self.assert_pipelined('s*2 + b', {'s': s, 'b': b})
+        self.assert_pipelined('b*2 + 1', {'b': b}, out=empty(n, dtype='>f8'))
+        self.assert_pipelined('a*2 + b', {'a': a, 'b': b},
+                              out=empty(n, dtype='float32'),
+                              casting='unsafe')
+
+    def test_memory_cap(self):
+        n = 100003
+        s = linspace(0, 1, n).astype('>f8')
+        evaluate('s*2')    # compile it, as its constants count too
+        current = numexpr.get_memory_usage()['current']
+        numexpr.set_memory_cap(sum(list(current.values())) + 100000)
+        expected, serial = self.buffers_peak('s*2', {'s': s}, False)
+        res, pipelined = self.buffers_peak('s*2', {'s': s}, True)
+        # The larger buffers would not fit, so the call is not pipelined
+        self.assertEqual(pipelined, serial)
+        assert_array_equal(res, expected)
+
+    def test_casts(self):
+        n = 100003
+        a = arange(n, dtype='float32')
+        b = linspace(0, 1, n)
+        assert_array_almost_equal(evaluate('a*2 + b'), a*2 + b)
+        out = empty(n, dtype='float32')
+        evaluate('a*2 + b', out=out, casting='unsafe')
+        assert_array_almost_equal(out, (a*2 + b).astype('float32'))
+        out = empty(n, dtype='bool')
+        evaluate('a > b*n', out=out)
+        assert_array_equal(out, a > b*n)
+
+    def test_strided(self):
+        n = 100003
+        c = arange(2*n, dtype='float64')[::2]
+        raw = zeros(8*n + 1, dtype='uint8')
+        m = raw[1:].view('float64')
+        m[:] = linspace(0, 1, n)
+        assert_array_almost_equal(evaluate('sin(c) + m'), sin(c) + m)
+        x = arange(3*300*500, dtype='float32').reshape(300, 1500)[:, ::3]
+        assert_array_almost_equal(evaluate('x*2 + 1'), x*2 + 1)
+        out = zeros(2*n)[::2]
+        evaluate('c*m', out=out)
+        assert_array_almost_equal(out, c*m)
+
+    def test_same_as_serial(self):
+        a = arange(100003, dtype='int32')
+        b = linspace(0, 1, 100003)
+        expected = evaluate('where(a % 3 > 0, a*b, -b)')
+        numexpr.set_pipelined_buffering(False)
+        assert_array_equal(evaluate('where(a % 3 > 0, a*b, -b)'), expected)
+
+
+class test_isa(TestCase):
+    def setUp(self):
+        self.level = numexpr.get_isa_level()
+
+    def tearDown(self):
+        numexpr.set_isa_level(self.level)
+
+    def test_levels(self):
+        self.assertEqual(numexpr.isa_levels[0], 'baseline')
+        self.assertTrue(self.level in numexpr.isa_levels)
+        self.assertEqual(numexpr.set_isa_level('baseline'), self.level)
+        self.assertEqual(numexpr.get_isa_level(), 'baseline')
+        self.assertRaises(ValueError, numexpr.set_isa_level, 'x86-64-v9')
+        self.assertEqual(numexpr.get_isa_level(), 'baseline')
+
+    def test_same_results(self):
+        n = 10007
+        a = linspace(0, 1, n)
+        b = arange(n, dtype='float32')
+        i = arange(n, dtype='int64')
+        c = a + 1j*a[::-1]
+        v = a[:9999].reshape(3333, 3)
+        w = a[1:10000].reshape(3333, 3)
+        exprs = ['a*b + 1', 'sqrt(a)*b - a', 'where(i % 3 > 0, a*b, -b)',
+                 'i*3 + i % 7', 'exp(c)*c + a', 'c/(c + 1)', 'sum(a*b - b)',
+                 'prod(a + 1)', 'prod(c)', 'cross(v, w)', 'dot(v, w)']
+        numexpr.set_isa_level('baseline')
+        expected = {}
+        for ex in exprs:
+            expected[ex] = evaluate(ex)
+        for level in numexpr.isa_levels:
+            numexpr.set_isa_level(level)
+            for ex in exprs:
+                assert_array_equal(evaluate(ex), expected[ex],
+                                   err_msg=level + ': ' + ex)
+
+    def test_environment(self):
+        with _environment('NUMEXPR_ISA', 'baseline'):
+            self.assertEqual(numexpr.detect_isa_level(), 'baseline')
+        with _environment('NUMEXPR_ISA', 'x86-64-v9'):
+            with warnings.catch_warnings(record=True) as w:
+                warnings.simplefilter('always')
+                level = numexpr.detect_isa_level()
+            self.assertEqual(level, numexpr.isa_levels[-1])
+            self.assertEqual(len(w), 1)
+
+
 @contextmanager
 def _environment(key, value):
     old = os.environ.get(key)
@@ -954,6 +1845,24 @@ def suite():
         theSuite.addTest(
             unittest.makeSuite(test_irregular_stride))
         theSuite.addTest(unittest.makeSuite(test_zerodim))
+        theSuite.addTest(unittest.makeSuite(test_chunked))
+        theSuite.addTest(unittest.makeSuite(test_carray))
+        theSuite.addTest(unittest.makeSuite(test_incremental))
+        theSuite.addTest(unittest.makeSuite(test_result_cache))
+        theSuite.addTest(unittest.makeSuite(test_records))
+        theSuite.addTest(unittest.makeSuite(test_tiled))
+        if scipy_sparse is not None:
+            theSuite.addTest(unittest.makeSuite(test_sparse))
+        theSuite.addTest(unittest.makeSuite(test_vectors))
+        theSuite.addTest(unittest.makeSuite(test_profile))
+        theSuite.addTest(unittest.makeSuite(test_timing))
+        theSuite.addTest(unittest.makeSuite(test_perf_counters))
+        theSuite.addTest(unittest.makeSuite(test_cost))
+        theSuite.addTest(unittest.makeSuite(test_memory))
+        theSuite.addTest(unittest.makeSuite(test_scheduler))
+        theSuite.addTest(unittest.makeSuite(test_tails))
+        theSuite.addTest(unittest.makeSuite(test_pipelining))
+        theSuite.addTest(unittest.makeSuite(test_isa))
         theSuite.addTest(unittest.makeSuite(test_threading_config))
 
         # multiprocessing module is not supported on Hurd/kFreeBSD
@@ -0,0 +1,106 @@
+###################################################################
+#  Numexpr - Fast numerical array expression evaluator for NumPy.
+#
+#      License: MIT
+#      Author:  See AUTHORS.txt
+#
+#  See LICENSE.txt and LICENSES/*.txt for details about copyright and
+#  rights to use.
+####################################################################
+
+"""
+Evaluation of 2-d expressions over cache-sized tiles.
+
+Outer-product like expressions (e.g. ``a[:, None] - b[None, :]``) and
+mixes of C and Fortran ordered operands force the iterator to buffer
+operands or to walk some of them with large strides.  Evaluating the
+expression over square tiles keeps the pieces of every operand (and of
+the broadcast ones) in cache while they are used.
+"""
+
+import numpy
+
+from numexpr.necompiler import (
+    getContext, getCachedExprNames, getArguments, getCachedNumExpr)
+from numexpr.chunked import _broadcast_shape, _check_elementwise
+
+# The default number of elements in a tile
+TILE_ELEMENTS = 2 ** 16
+
+
+def _default_tile(shape):
+    side = int(TILE_ELEMENTS ** 0.5)
+    rows = min(shape[0], side)
+    # Use the whole width of the tile budget for narrow outcomes
+    cols = min(shape[1], max(side, TILE_ELEMENTS // max(rows, 1)))
+    return max(rows, 1), max(cols, 1)
+
+
+def _tile_of(a, rows, cols):
+    """The tile of the 2-d (or broadcast) operand `a`."""
+    if a.ndim < 2:
+        a = a.reshape((1,) * (2 - a.ndim) + a.shape)
+    return a[rows if a.shape[0] != 1 else slice(None),
+             cols if a.shape[1] != 1 else slice(None)]
+
+
+def _layout(arguments):
+    """'F' if all the 2-d operands are Fortran ordered, else 'C'."""
+    arrays = [a for a in arguments if a.ndim == 2 and a.size > 1]
+    if arrays and all(a.flags.f_contiguous and not a.flags.c_contiguous
+                      for a in arrays):
+        return 'F'
+    return 'C'
+
+
+def evaluate_tiled(ex, local_dict=None, global_dict=None, out=None,
+                   tile=None, order='K', casting='safe', **kwargs):
+    """Evaluate a 2-d element-wise expression over cache-sized tiles.
+
+    This works like `evaluate()`, but the outcome (which must be 2-d)
+    is computed by tiles of `tile` (rows, columns), so that every
+    operand is accessed with good locality even if it is broadcast or
+    has a different memory layout than the others.  By default, square
+    tiles of about `TILE_ELEMENTS` elements are used.
+
+    See `evaluate()` for the rest of parameters.  Reductions are not
+    supported.
+    """
+    if not isinstance(ex, (str, unicode)):
+        raise ValueError("must specify expression as a string")
+    context = getContext(kwargs, frame_depth=1)
+    expr_key, (names, ex_uses_vml) = getCachedExprNames(ex, context)
+    arguments = [numpy.asarray(a) for a in
+                 getArguments(names, local_dict, global_dict, frame_depth=1)]
+    shape = _broadcast_shape([a.shape for a in arguments])
+    if len(shape) != 2:
+        raise ValueError("tiled evaluation needs a 2-dimensional outcome")
+    compiled_ex = getCachedNumExpr(ex, expr_key, names, arguments, context)
+    _check_elementwise(compiled_ex)
+    kwargs = {'order': order, 'casting': casting, 'ex_uses_vml': ex_uses_vml}
+
+    nrows, ncols = shape
+    trows, tcols = tile if tile is not None else _default_tile(shape)
+    if out is None:
+        layout = _layout(arguments)
+    else:
+        layout = _layout([out])
+    tiles = [(slice(i, min(i + trows, nrows)),
+              slice(j, min(j + tcols, ncols)))
+             for i in range(0, nrows, trows) for j in range(0, ncols, tcols)]
+    if layout == 'F':
+        # Walk the tiles in the order of the outcome memory
+        tiles.sort(key=lambda t: (t[1].start, t[0].start))
+    for rows, cols in tiles:
+        args = [_tile_of(a, rows, cols) for a in arguments]
+        if out is None:
+            # The type of the outcome is known after the first tile
+            first = compiled_ex(*args, **kwargs)
+            out = numpy.empty(shape, dtype=first.dtype, order=layout)
+            out[rows, cols] = first
+        else:
+            compiled_ex(*args, out=out[rows, cols], **kwargs)
+    if out is None:
+        # Empty outcome
+        out = compiled_ex(*arguments, **kwargs)
+    return out
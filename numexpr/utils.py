@@ -10,8 +10,17 @@
 
 import os
 import subprocess
+import collections
+import json
+from timeit import default_timer
 
-from numexpr.interpreter import _set_num_threads
+import numpy
+
+from numexpr.interpreter import (
+    _set_num_threads, _set_profiling, _set_timing, _get_thread_stats,
+    _set_perf_counters, _perf_counters_valid, _get_thread_perf_counters,
+    _set_memory_cap, _get_memory, _set_scheduler, _available_schedulers,
+    _set_vml_auto_threads, _set_pipelining, _set_isa, _available_isas)
 from numexpr import use_vml
 
 if use_vml:
@@ -94,6 +103,242 @@ def set_num_threads(nthreads):
     return old_nthreads
 
 
+schedulers = tuple(_available_schedulers())
+"""The backends that can run the threads of parallel calls."""
+
+_scheduler = 'pool'
+
+
+def set_scheduler(kind, parallel_for=None):
+    """
+    Selects the backend that runs the threads of parallel calls.
+
+    `kind` can be:
+
+    - 'pool': the pool of threads of numexpr (the default).
+    - 'openmp': an OpenMP parallel region, so that numexpr shares the
+      threads of other OpenMP code in the process.  Only available when
+      numexpr was built with OpenMP (see the NUMEXPR_OPENMP environment
+      variable of setup.py).
+    - 'callback': a "parallel for" of the application, so that numexpr
+      runs in its thread pool (TBB, a concurrent.futures executor...).
+      `parallel_for` is either a Python callable, called as
+      `parallel_for(task, n)`, that must call `task(i)` once for every
+      `i` in `range(n)` (from any threads, as `task` releases the GIL)
+      and return when all of them have, or a PyCapsule named
+      "numexpr.parallel_for" holding a C `nx_parallel_for_def` (see
+      scheduler.hpp), which is called without the GIL.
+
+    Every call is split in as many tasks as threads set with
+    `set_num_threads()`.  The tasks that a backend does not run are run
+    by the calling thread, and an exception raised by `parallel_for`
+    is raised by the call.  `schedulers` lists the available backends.
+
+    Returns the previous backend.
+    """
+    global _scheduler
+    if kind == 'callback' and parallel_for is None:
+        raise ValueError("the 'callback' scheduler needs a `parallel_for`")
+    old = _set_scheduler(kind, parallel_for)
+    _scheduler = kind
+    return old
+
+
+def get_scheduler():
+    """Returns the backend that runs the threads of parallel calls."""
+    return _scheduler
+
+
+def set_pipelined_buffering(enabled):
+    """
+    Enables or disables the pipelined buffering of serial evaluations.
+
+    When the operands need buffering (casts between types, misaligned
+    or non-contiguous data), the copies into the buffers and the
+    computation run one after the other.  When enabled, evaluations run
+    in a single thread (see `set_num_threads()`) that need buffering
+    use two sets of larger buffers: while one of them is computed, a
+    helper thread writes the outputs of the other back and fills it with
+    the next inputs.  This hides most of the cost of the copies, at the
+    expense of a helper thread and more memory for the buffers.
+
+    Returns the previous setting.
+    """
+    return bool(_set_pipelining(bool(enabled)))
+
+
+isa_levels = tuple(_available_isas())
+"""The ISA levels of the VM engines that this CPU supports, best last."""
+
+_isa_level = isa_levels[-1]
+
+
+def set_isa_level(level):
+    """
+    Selects the instruction set that the engines of the VM are run with.
+
+    The engines are compiled for several x86-64 levels: 'baseline'
+    (whatever numexpr was built for), 'x86-64-v2' (SSE4.2), 'x86-64-v3'
+    (AVX2) and 'x86-64-v4' (AVX-512), and the best one that the CPU
+    supports is used by default.  The other levels are mostly useful
+    for testing and benchmarking, and can also be selected at import
+    time with the NUMEXPR_ISA environment variable.  Every level gives
+    the same results.  `isa_levels` lists the supported levels (only
+    'baseline' on compilers or machines other than GCC/Clang on x86).
+
+    Returns the previous level.
+    """
+    global _isa_level
+    old = _set_isa(level)
+    _isa_level = level
+    return old
+
+
+def get_isa_level():
+    """Returns the ISA level that the engines of the VM are run with."""
+    return _isa_level
+
+
+def detect_isa_level():
+    """
+    Returns the ISA level in the NUMEXPR_ISA environment variable, or
+    the best one that the CPU supports.
+    """
+    level = os.environ.get('NUMEXPR_ISA', isa_levels[-1])
+    if level not in isa_levels:
+        import warnings
+        warnings.warn("NUMEXPR_ISA=%r is not supported here (use one of %s)"
+                      % (level, ", ".join(isa_levels)))
+        level = isa_levels[-1]
+    return level
+
+
+def set_vml_auto_threads(enabled):
+    """
+    Keeps VML single threaded inside the threads of parallel calls.
+
+    When enabled (the default), every thread of a parallel call limits
+    the VML functions it calls to one thread, so that the threads of
+    VML (see `set_vml_num_threads()`) and the ones of numexpr do not
+    oversubscribe the cores.  Serial calls still use the threads of
+    VML.  This is a no-op if numexpr was not built with VML.
+
+    Returns the previous setting.
+    """
+    return bool(_set_vml_auto_threads(bool(enabled)))
+
+
+def set_profiling(enabled):
+    """
+    Enables or disables the instruction counters of the VM.
+
+    While enabled, every instruction run by the VM counts the blocks and
+    elements it has processed and the time spent on them, which can be
+    retrieved with `profile()`.  This adds a small overhead to every
+    instruction, so it is disabled by default.
+
+    Returns the previous setting.
+    """
+    return bool(_set_profiling(bool(enabled)))
+
+
+# The hardware counters read by the VM
+perf_counter_names = ('cycles', 'instructions', 'cache_misses',
+                      'branch_misses')
+
+
+def set_perf_counters(enabled):
+    """
+    Enables or disables the hardware performance counters of the VM.
+
+    While enabled, every thread running an evaluation reads its user
+    space cycles, instructions, last level cache misses and branch
+    misses before and after it, which can be retrieved with
+    `perf_counters()` (per expression) and `get_thread_perf_counters()`
+    (per thread, for the last parallel call).  This is only supported
+    on Linux, and needs the permission to open perf events (see
+    `perf_counters_available()`); otherwise, the counters are just
+    reported as None.
+
+    Returns the previous setting.
+    """
+    return bool(_set_perf_counters(bool(enabled)))
+
+
+def perf_counters_available():
+    """
+    Returns the names of the hardware counters that can be read.
+    """
+    valid = _perf_counters_valid()
+    return [name for i, name in enumerate(perf_counter_names)
+            if valid & (1 << i)]
+
+
+def get_thread_perf_counters():
+    """
+    Returns the hardware counters of every thread in the last parallel
+    call made while they were enabled, as a list of dictionaries (see
+    `perf_counters()`).
+    """
+    result = []
+    for counters in _get_thread_perf_counters():
+        valid = counters[0]
+        result.append(dict((name, counters[1 + i] if valid & (1 << i)
+                            else None)
+                           for i, name in enumerate(perf_counter_names)))
+    return result
+
+
+# The categories of the memory used by the VM
+memory_categories = ('temporaries', 'buffers', 'output', 'constants')
+
+
+def memory_dict(usage):
+    """The dictionary form of a (current, peak, peak total) usage."""
+    current, peak, peak_total = usage
+    return {'current': dict(zip(memory_categories, current)),
+            'peak': dict(zip(memory_categories, peak)),
+            'peak_total': peak_total}
+
+
+def set_memory_cap(nbytes):
+    """
+    Sets the most memory (in bytes) that numexpr may use.
+
+    The memory counted is the one of the blocks of constants of the
+    compiled expressions and the one taken by the calls while they run
+    (see `get_memory_usage()`).  When a call would exceed the cap, it
+    is run with less threads and, if running serially is not enough,
+    with smaller blocks (down to 64 elements).  A cap of None (or 0)
+    means no limit, which is the default.
+
+    Returns the previous cap.
+    """
+    return _set_memory_cap(int(nbytes or 0)) or None
+
+
+def get_memory_usage(reset=False):
+    """
+    Returns the memory (in bytes) used by numexpr in the whole process.
+
+    The outcome is a dictionary with the memory currently used (under
+    'current') and at most (under 'peak') by every category:
+
+      * 'temporaries': the temporaries of every thread.
+      * 'buffers': the buffers of the iterator and its per-thread copies
+        (an upper bound, as only some operands may need them).
+      * 'output': the buffers of every thread for an output overlapping
+        the inputs.
+      * 'constants': the blocks of constants of the compiled
+        expressions.
+
+    'peak_total' is the peak of the sum of all the categories.  If
+    `reset` is true, the peaks are reset to the current values after
+    being returned.
+    """
+    return memory_dict(_get_memory(bool(reset)))
+
+
 def detect_number_of_cores():
     """
     Detects the number of cores on a system. Cribbed from pp.
@@ -151,3 +396,233 @@ class CacheDict(dict):
                 super(CacheDict, self).__delitem__(k)
         super(CacheDict, self).__setitem__(key, value)
 
+
+
+class ResultCache(object):
+    """
+    A cache of outcomes of `evaluate()`, bounded by their total size.
+
+    Entries are keyed on the compiled program and the data pointer,
+    shape, strides and type of every operand, plus a user supplied
+    version token.  References to the operands are kept, so that their
+    memory cannot be reused while an entry is alive.  The least recently
+    used entries are evicted first, and the ones computed from modified
+    operands right away.
+    """
+
+    def __init__(self, maxbytes=0):
+        self.maxbytes = maxbytes
+        self.nbytes = 0
+        self.entries = {}
+        self.tick = 0
+
+    def _root(self, a):
+        while isinstance(getattr(a, 'base', None), numpy.ndarray):
+            a = a.base
+        return a
+
+    def key(self, compiled_ex, arguments, order, casting, version):
+        operands = []
+        for a in arguments:
+            if a.ndim == 0:
+                # Scalars are new objects every time, so use their value
+                operands.append((a.dtype.str, a.tobytes()))
+            else:
+                operands.append((a.__array_interface__['data'][0],
+                                 a.shape, a.strides, a.dtype.str))
+        return (id(compiled_ex), order, casting, version, tuple(operands))
+
+    def get(self, key):
+        entry = self.entries.get(key)
+        if entry is None:
+            return None
+        self.tick += 1
+        entry[0] = self.tick
+        return entry[1]
+
+    def put(self, key, result, compiled_ex, arguments):
+        if result.nbytes > self.maxbytes:
+            return
+        result.flags.writeable = False
+        self.tick += 1
+        self.entries[key] = [self.tick, result, compiled_ex, arguments]
+        self.nbytes += result.nbytes
+        self.shrink(self.maxbytes)
+
+    def shrink(self, maxbytes):
+        """Evict the least recently used entries until `maxbytes` fit."""
+        if self.nbytes <= maxbytes:
+            return
+        for key, entry in sorted(self.entries.items(),
+                                 key=lambda item: item[1][0]):
+            del self.entries[key]
+            self.nbytes -= entry[1].nbytes
+            if self.nbytes <= maxbytes:
+                break
+
+    def mark_modified(self, arrays):
+        """Evict the entries computed from any array sharing memory
+        with `arrays`."""
+        # The entries keep their operands alive, so the ids of their
+        # roots cannot have been reused
+        roots = set(id(self._root(a)) for a in arrays)
+        for key, entry in list(self.entries.items()):
+            if any(id(self._root(a)) in roots for a in entry[3]):
+                del self.entries[key]
+                self.nbytes -= entry[1].nbytes
+
+
+result_cache = ResultCache()
+
+
+def set_result_cache_size(maxbytes):
+    """
+    Sets the maximum size (in bytes) of the cache of outcomes.
+
+    Returns the previous setting.  The cache is disabled (0) by
+    default.  When enabled, `evaluate()` returns the cached outcome
+    for an expression whose operands are the very same arrays (same
+    memory, shape and strides) as in a previous call, instead of
+    computing it again.  Cached outcomes are read-only.
+
+    Operands modified in place (other than as the `out` of
+    `evaluate()`) are not detected: call `mark_modified()` on them after
+    modifying them, or pass a new `cache_version` to `evaluate()`.
+    """
+    old_maxbytes = result_cache.maxbytes
+    result_cache.maxbytes = maxbytes
+    result_cache.shrink(maxbytes)
+    return old_maxbytes
+
+
+def mark_modified(*arrays):
+    """
+    Tells the cache of outcomes that `arrays` have been modified.
+
+    Outcomes computed from any array sharing memory with them (including
+    views) are not returned from the cache anymore.
+    """
+    result_cache.mark_modified(arrays)
+
+
+class Timings(object):
+    """
+    The time spent on the phases of the calls to `evaluate()`, for the
+    last calls and added up per expression (see `get_timings()`).
+    """
+
+    phases = ('parse', 'setup', 'copies', 'compute', 'barrier', 'finalize',
+              'total')
+
+    def __init__(self, history=1000):
+        self.enabled = False
+        self.calls = collections.deque(maxlen=history)
+        self.expressions = {}
+
+    def add(self, ex, start, parsed, compiled_ex):
+        record = compiled_ex.get_timing()
+        record['parse'] = parsed - start
+        record['total'] = default_timer() - start
+        totals = self.expressions.get(ex)
+        if totals is None:
+            totals = self.expressions[ex] = dict.fromkeys(self.phases, 0.0)
+            totals['calls'] = 0
+            totals['max_imbalance'] = 1.0
+        totals['calls'] += 1
+        totals['max_imbalance'] = max(totals['max_imbalance'],
+                                      record['imbalance'])
+        for phase in self.phases:
+            totals[phase] += record[phase]
+        record['expression'] = ex
+        self.calls.append(record)
+
+    def reset(self):
+        self.calls.clear()
+        self.expressions.clear()
+
+
+timings = Timings()
+
+
+def set_timing(enabled):
+    """
+    Enables or disables the timing of the phases of `evaluate()` calls.
+
+    Returns the previous setting.  See `get_timings()` for the phases.
+    """
+    old_enabled = timings.enabled
+    timings.enabled = bool(enabled)
+    _set_timing(timings.enabled)
+    return old_enabled
+
+
+def get_timings(reset=False):
+    """
+    Returns the time (in seconds) spent on the phases of `evaluate()`.
+
+    The outcome is a dictionary with the records of the last calls
+    (under 'calls', oldest first) and their totals per expression
+    (under 'expressions'), both as dictionaries with the time spent on
+    every phase:
+
+      * 'parse': looking up the operands and the compiled expression.
+      * 'setup': checking the operands and building the iterator.
+      * 'copies': iterator copies, buffers and temporaries for threads.
+      * 'compute': running the program (including barrier waits).
+      * 'barrier': mean time the threads waited for the slowest one.
+      * 'finalize': releasing the iterators and getting the outcome.
+      * 'total': the whole call.
+
+    The records of the calls also have the number of elements ('size'),
+    the threads used ('nthreads') and the busy time of the busiest
+    thread over the mean one ('imbalance', 1 for serial calls), whose
+    maximum is kept per expression ('max_imbalance').  Only the calls
+    made while timing was enabled (see `set_timing()`) are recorded.
+    If `reset` is true, the records are cleared after being returned.
+    """
+    result = {'calls': [dict(record) for record in timings.calls],
+              'expressions': dict((ex, dict(totals)) for ex, totals in
+                                  timings.expressions.items())}
+    if reset:
+        timings.reset()
+    return result
+
+
+def dump_timings(fileobj, reset=False):
+    """
+    Writes the outcome of `get_timings()` to `fileobj` as JSON.
+    """
+    json.dump(get_timings(reset), fileobj, indent=1, sort_keys=True)
+
+
+_thread_fields = ('calls', 'tasks', 'elements', 'busy', 'idle', 'barrier')
+
+
+def get_thread_stats(reset=False):
+    """
+    Returns the work done by every thread of the pool.
+
+    The outcome is a dictionary with the work of every thread in the
+    last parallel call (under 'last') and added up over all the calls
+    since the last reset (under 'total'), as lists of dictionaries with:
+
+      * 'calls': parallel calls the thread has taken part in.
+      * 'tasks': tasks (ranges of blocks) claimed by the thread.
+      * 'elements': elements processed by the thread.
+      * 'busy': time (in seconds) spent running tasks.
+      * 'idle': time waiting to start or to claim the next task.
+      * 'barrier': time waiting for the other threads to finish.
+
+    The 'imbalance' of the last call is the busy time of the busiest
+    thread over the mean one (1 means a perfect balance).  Only the
+    parallel calls made while timing was enabled (see `set_timing()`)
+    are accounted.  If `reset` is true, the work is cleared after
+    being returned.
+    """
+    last, total = _get_thread_stats(bool(reset))
+    last = [dict(zip(_thread_fields, stats)) for stats in last]
+    total = [dict(zip(_thread_fields, stats)) for stats in total]
+    busy = [stats['busy'] for stats in last]
+    mean = sum(busy) / len(busy) if busy else 0
+    return {'last': last, 'total': total,
+            'imbalance': max(busy) / mean if mean > 0 else 1.0}
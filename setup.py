@@ -12,7 +12,9 @@
 import shutil
 import os
 import sys
+import subprocess
 import os.path as op
+from distutils.cmd import Command
 from distutils.command.clean import clean
 
 
@@ -133,17 +135,59 @@ def setup_package():
             extension_config_data = {
                 'sources': ['numexpr/interpreter.cpp',
                             'numexpr/module.cpp',
-                            'numexpr/numexpr_object.cpp'] + pthread_win,
+                            'numexpr/numexpr_object.cpp',
+                            'numexpr/codec.cpp',
+                            'numexpr/perfevents.cpp',
+                            'numexpr/scheduler.cpp',
+                            'numexpr/pipeline.cpp'] + pthread_win,
                 'depends': ['numexpr/interp_body.cpp',
+                            'numexpr/interp_engines.cpp',
+                            'numexpr/codec.hpp',
                             'numexpr/complex_functions.hpp',
                             'numexpr/interpreter.hpp',
+                            'numexpr/isa.hpp',
                             'numexpr/module.hpp',
                             'numexpr/msvc_function_stubs.hpp',
                             'numexpr/numexpr_config.hpp',
-                            'numexpr/numexpr_object.hpp'],
+                            'numexpr/numexpr_object.hpp',
+                            'numexpr/perfevents.hpp',
+                            'numexpr/pipeline.hpp',
+                            'numexpr/profiler.hpp',
+                            'numexpr/scheduler.hpp'],
                 'libraries': ['m'],
                 'extra_compile_args': ['-funroll-all-loops', ],
             }
+            # The 'openmp' scheduler (see numexpr/scheduler.hpp) is opt-in
+            if os.environ.get('NUMEXPR_OPENMP'):
+                if os.name == 'nt':
+                    dict_append(extension_config_data,
+                                extra_compile_args=['/openmp'])
+                else:
+                    dict_append(extension_config_data,
+                                extra_compile_args=['-fopenmp'],
+                                extra_link_args=['-fopenmp'])
+            # Profile-guided optimization with GCC (see the build_pgo
+            # command): 'generate' builds an instrumented extension, that
+            # writes its profiles to NUMEXPR_PGO_DIR, and 'use' builds the
+            # optimized one from them
+            pgo = os.environ.get('NUMEXPR_PGO')
+            pgo_dir = os.environ.get('NUMEXPR_PGO_DIR',
+                                     localpath('build', 'pgo'))
+            if pgo == 'generate':
+                pgo_flags = ['-fprofile-generate=' + pgo_dir,
+                             '-fprofile-update=prefer-atomic']
+                dict_append(extension_config_data,
+                            extra_compile_args=pgo_flags,
+                            extra_link_args=pgo_flags)
+            elif pgo == 'use':
+                # The engines of the ISA levels that the training machine
+                # lacks have no profile, and are optimized as usual
+                dict_append(extension_config_data,
+                            extra_compile_args=['-fprofile-use=' + pgo_dir,
+                                                '-fprofile-partial-training',
+                                                '-Wno-missing-profile'])
+            elif pgo:
+                raise ValueError("NUMEXPR_PGO must be 'generate' or 'use'")
             dict_append(extension_config_data, **mkl_config_data)
             if 'library_dirs' in mkl_config_data:
                 library_dirs = ':'.join(mkl_config_data['library_dirs'])
@@ -195,6 +239,49 @@ def setup_package():
 
                 clean.run(self)
 
+        class build_pgo(Command):
+            """Builds the extension with profile-guided optimization:
+            builds it instrumented (in build/pgo-lib), runs the training
+            workload (`python bench/suite.py train`) with it, and builds
+            the optimized extension from the profiles.  Use it before
+            `install`, e.g. `python setup.py build_pgo install`."""
+
+            description = "build the extension with profile-guided " \
+                          "optimization (GCC)"
+            user_options = [('profile-dir=', None,
+                             "directory of the profiles (default build/pgo)")]
+
+            def initialize_options(self):
+                self.profile_dir = None
+
+            def finalize_options(self):
+                if self.profile_dir is None:
+                    self.profile_dir = localpath('build', 'pgo')
+                self.profile_dir = op.abspath(self.profile_dir)
+
+            def setup(self, stage, *args):
+                env = dict(os.environ, NUMEXPR_PGO=stage,
+                           NUMEXPR_PGO_DIR=self.profile_dir)
+                subprocess.check_call([sys.executable, localpath('setup.py')] +
+                                      list(args), env=env)
+
+            def run(self):
+                # Both builds share build_temp, so that the profiles match
+                # the paths of the objects
+                instrumented = localpath('build', 'pgo-lib')
+                # Start over (the instrumented builds add the counts up)
+                if op.isdir(self.profile_dir):
+                    for name in os.listdir(self.profile_dir):
+                        if name.endswith('.gcda'):
+                            os.remove(op.join(self.profile_dir, name))
+                self.setup('generate', 'build', '--force',
+                           '--build-lib', instrumented)
+                env = dict(os.environ, PYTHONPATH=instrumented)
+                subprocess.check_call([sys.executable,
+                                       localpath('bench', 'suite.py'),
+                                       'train'], env=env)
+                self.setup('use', 'build', '--force')
+
         class build_ext(numpy_build_ext):
             def build_extension(self, ext):
                 # at this point we know what the C compiler is.
@@ -211,6 +298,7 @@ def setup_package():
 
         metadata['cmdclass'] = {
             'build_ext': build_ext,
+            'build_pgo': build_pgo,
             'clean': cleaner,
             'build_py': build_py,
         }